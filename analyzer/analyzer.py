@@ -24,9 +24,9 @@ def timestr2int(timestr):
 
 def extract_ethstats_log(dirname):
     filename = f"{repository_dir}/logs/{dirname}/ethstats.log"
-    if not os.path.exists(filename):
+    if not log_exists(filename):
         return []
-    f = open(filename)
+    f = open_log(filename)
     row = f.readline()
 
     result = []
@@ -63,10 +63,10 @@ def extract_ethstats_log(dirname):
 
 def extract_ifstat_log(dirname):
     filename = f"{repository_dir}/logs/{dirname}/ifstat.log"
-    if not os.path.exists(filename):
+    if not log_exists(filename):
         return []
     
-    f = open(filename)
+    f = open_log(filename)
     hosts = f.readline().split()
     header = f.readline().split()
     row  = f.readline()
@@ -0,0 +1,184 @@
+"""Throughput of the analyzer pipeline on synthetic logs.
+
+generate_logs writes ifstat, ethstats and iperf3 json logs shaped like the testbed ones for a given scale
+(experiments x host pairs x duration x iperf interval), then every stage runs in a fresh interpreter on them:
+
+    analyzer             ifstat.log, ethstats.log -> analysis_microsecond.csv, analysis_second.csv
+    iperf_analyzer       hs*_iperf.log, hr*_iperf.log -> analysis_send.csv, analysis_rec.csv
+    gen_tensorboard      analysis_second.csv -> tf_logs_1
+    gen_iperf_tensorboard  analysis_send.csv -> tf_send_logs
+
+and reports its input MB/s, rows/s and peak resident memory. The tensorboard stages are skipped without torch.
+"""
+import os
+import json
+import time
+import random
+import shutil
+import tempfile
+import resource
+import multiprocessing
+from util import print_t
+
+STAGES = ['analyzer', 'iperf_analyzer', 'gen_tensorboard', 'gen_iperf_tensorboard']
+IFSTAT_INTERVAL = 0.1 # seconds, like monitor_network
+KERNEL = "5.13.12bbr2"
+
+def ifstat_log(interfaces, duration, start, rng):
+    """ifstat -t -a -z -l -n -T -b -q 0.1 output of the s2 namespace"""
+    columns = ['lo'] + interfaces + ['Total']
+    lines = ["  Time    " + "".join(f"{_:>20}" for _ in columns),
+             "HH:MM:SS  " + "   Kbps in  Kbps out" * len(columns)]
+    for i in range(int(duration / IFSTAT_INTERVAL)):
+        now = time.gmtime(start + i * IFSTAT_INTERVAL)
+        values = [rng.uniform(0, 100000) for _ in range(2 * (len(columns) - 1))]
+        values += [sum(values[0::2]), sum(values[1::2])]
+        lines.append(time.strftime("%H:%M:%S", now) + "".join(f"{_:10.2f}" for _ in values))
+    return "\n".join(lines) + "\n"
+
+def ethstats_log(interfaces, duration, start, rng):
+    """ethstats -t -n 1 output, a total line with the timestamp then one line per interface"""
+    lines = []
+    for second in range(int(duration)):
+        rows = [(rng.uniform(0, 100), rng.uniform(0, 100), rng.uniform(0, 9000), rng.uniform(0, 9000))
+                for _ in interfaces]
+        total = [sum(_) for _ in zip(*rows)]
+        lines.append(f"   {start + second}    total: {total[0]:8.2f} Mb/s In {total[1]:8.2f} Mb/s Out - "
+                     f"{total[2]:8.1f} p/s In {total[3]:8.1f} p/s Out")
+        for name, row in zip(interfaces, rows):
+            lines.append(f"{name:>16}: {row[0]:8.2f} Mb/s In {row[1]:8.2f} Mb/s Out - "
+                         f"{row[2]:8.1f} p/s In {row[3]:8.1f} p/s Out")
+    return "\n".join(lines) + "\n"
+
+def iperf_log(sender, duration, interval, start, rng):
+    """iperf3 -J output with the fields iperf_analyzer reads"""
+    intervals = []
+    for i in range(int(duration / interval)):
+        sent = rng.randint(0, 12500000) * interval
+        stream = {'socket': 5, 'start': i * interval, 'end': (i + 1) * interval, 'seconds': interval,
+                  'bytes': int(sent), 'bits_per_second': sent * 8 / interval, 'omitted': False, 'sender': sender}
+        if sender:
+            stream.update(retransmits=rng.randint(0, 3), snd_cwnd=rng.randint(14480, 2000000), snd_wnd=3145728,
+                          rtt=rng.randint(40000, 60000), rttvar=rng.randint(100, 5000), pmtu=1500)
+        intervals.append({'streams': [stream], 'sum': dict(stream)})
+    return json.dumps({'start': {'timestamp': {'time': time.ctime(start), 'timesecs': start}},
+                       'intervals': intervals, 'end': {}}, indent=4) + "\n"
+
+def generate_logs(root, experiments=10, hosts=2, duration=60, interval=0.1, seed=0):
+    """write synthetic experiment logs into root/logs, returns the bytes written"""
+    rng = random.Random(seed)
+    interfaces = [f"s{switch}-eth{i}" for switch in (1, 2) for i in range(1, hosts + 2)]
+    written = 0
+    for e in range(experiments):
+        start = 1650000000 + e * (duration + 10)
+        time_id = time.strftime("%Y-%m-%d-%H-%M-%S", time.gmtime(start))
+        dirname = os.path.join(root, 'logs', f"{time_id}_bbr_{hosts}hosts_delay=40ms_loss=0_bw=100_duration="
+                                             f"{duration}_start_delay=0_{KERNEL}")
+        os.makedirs(dirname)
+        files = {'ifstat.log': ifstat_log(interfaces, duration, start, rng),
+                 'ethstats.log': ethstats_log(interfaces, duration, start, rng)}
+        for i in range(1, hosts + 1):
+            files[f'hs{i}_iperf.log'] = iperf_log(True, duration, interval, start, rng)
+            files[f'hr{i}_iperf.log'] = iperf_log(False, duration, interval, start, rng)
+        for filename, content in files.items():
+            with open(os.path.join(dirname, filename), 'w') as f:
+                f.write(content)
+            written += len(content)
+    return written
+
+def file_size(root, suffixes):
+    """bytes of the logs ending with one of suffixes"""
+    return sum(os.path.getsize(os.path.join(dirpath, filename))
+               for dirpath, _, filenames in os.walk(os.path.join(root, 'logs'))
+               for filename in filenames if filename.endswith(tuple(suffixes)))
+
+def count_rows(root, filenames):
+    rows = 0
+    for filename in filenames:
+        with open(os.path.join(root, filename)) as f:
+            rows += sum(1 for _ in f) - 1
+    return rows
+
+def run_stage(stage, root, queue):
+    """run one stage in root, put (seconds, peak rss in MB) into queue, imports are not timed"""
+    os.chdir(root)
+    logs_path = os.path.join(root, 'logs')
+    if stage == 'analyzer':
+        import analyzer
+        analyzer.repository_dir, analyzer.logs_path = root, logs_path
+        work = lambda: (analyzer.extract_save_log('ifstat'), analyzer.extract_save_log('ethstats'))
+    elif stage == 'iperf_analyzer':
+        import iperf_analyzer
+        iperf_analyzer.logs_path = logs_path
+        dirnames = os.listdir(logs_path)
+        work = lambda: (iperf_analyzer.extract_save_send_log(dirnames), iperf_analyzer.extract_save_rec_log(dirnames))
+    elif stage == 'gen_tensorboard':
+        import gen_tensorboard
+        work = lambda: gen_tensorboard.write_tf_logs(gen_tensorboard.classify_logs('analysis_second.csv'), 1)
+    else:
+        import gen_iperf_tensorboard
+        work = lambda: gen_iperf_tensorboard.write_tf_logs(gen_iperf_tensorboard.classify_logs())
+    start = time.perf_counter()
+    work()
+    seconds = time.perf_counter() - start
+    queue.put((seconds, resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024))
+
+def stage_io(stage, root):
+    """(input bytes, rows) of a stage, rows written by the analyzers and read by the tensorboard stages"""
+    if stage == 'analyzer':
+        return (file_size(root, ['ifstat.log', 'ethstats.log']),
+                count_rows(root, ['analysis_microsecond.csv', 'analysis_second.csv']))
+    if stage == 'iperf_analyzer':
+        return file_size(root, ['_iperf.log']), count_rows(root, ['analysis_send.csv', 'analysis_rec.csv'])
+    filename = 'analysis_second.csv' if stage == 'gen_tensorboard' else 'analysis_send.csv'
+    return os.path.getsize(os.path.join(root, filename)), count_rows(root, [filename])
+
+def benchmark(experiments=10, hosts=2, duration=60, interval=0.1, stages=STAGES, root=None):
+    """generate logs at the given scale and time every stage on them in order
+
+    Args:
+        experiments, hosts, duration, interval: scale of the synthetic logs, refer to generate_logs
+        stages (list, optional): stages to run, later ones read the csv files of earlier ones. Defaults to all.
+        root (str, optional): working dir, kept afterwards. Defaults to None(a temporary dir, removed).
+    Returns:
+        list: one dict per stage with seconds, input_mb, mb_per_s, rows, rows_per_s, peak_rss_mb
+    """
+    workdir = root or tempfile.mkdtemp(prefix='bench_')
+    results = []
+    try:
+        generated = generate_logs(workdir, experiments, hosts, duration, interval)
+        print_t("info", f"generated {generated / 1e6:.1f}MB of logs in {workdir}")
+        context = multiprocessing.get_context('spawn')
+        for stage in stages:
+            if stage.startswith('gen_') and not has_torch():
+                print_t("warning", f"skip {stage}, needs torch")
+                continue
+            queue = context.Queue()
+            process = context.Process(target=run_stage, args=(stage, workdir, queue))
+            process.start()
+            process.join()
+            if process.exitcode:
+                print_t("warning", f"{stage} failed with exit code {process.exitcode}")
+                continue
+            seconds, peak_rss = queue.get()
+            size, rows = stage_io(stage, workdir)
+            results.append({'stage': stage, 'experiments': experiments, 'hosts': hosts, 'duration': duration,
+                            'interval': interval, 'seconds': seconds, 'input_mb': size / 1e6,
+                            'mb_per_s': size / 1e6 / seconds, 'rows': rows, 'rows_per_s': rows / seconds,
+                            'peak_rss_mb': peak_rss})
+    finally:
+        if not root:
+            shutil.rmtree(workdir)
+    return results
+
+def has_torch():
+    try:
+        import torch.utils.tensorboard
+        return True
+    except ImportError:
+        return False
+
+if __name__ == '__main__':
+    for result in benchmark(experiments=10, hosts=2, duration=60, interval=0.1):
+        print(f"{result['stage']:>22}: {result['seconds']:7.2f}s {result['mb_per_s']:7.1f}MB/s "
+              f"{result['rows_per_s']:10.0f}rows/s peak {result['peak_rss_mb']:7.1f}MB")
@@ -0,0 +1,81 @@
+import os
+import csv
+import json
+from util import print_t, open_log, log_exists
+from cube import load_metadata
+
+logs_path = "./logs"
+cross_file = "analysis_cross.csv"
+cross_summary_file = "analysis_cross_summary.csv"
+# interval lines of tools/crossgen.c, the sender writes hx1_cross.log and the sink hy1_cross.log
+CROSS_COLUMNS = ['start', 'end', 'udp_bytes', 'udp_pkts', 'udp_lost', 'tcp_bytes', 'flows_started', 'flows_done']
+cross_fieldnames = ['experiment_id', 'side', 'timestamp', 'udp_mbps', 'tcp_mbps', 'udp_lost', 'flows_started',
+                    'flows_done']
+summary_fieldnames = ['experiment_id', 'cross_traffic', 'sent_mbps', 'delivered_mbps', 'udp_sent_mbps',
+                      'udp_loss_rate', 'tcp_mbps', 'flows_started', 'flows_done']
+
+def extract_cross_log(filename):
+    """read the per interval counters of a crossgen sender or sink, timestamp is the epoch time of the interval end"""
+    records = []
+    with open_log(filename) as f:
+        start_time = float(f.readline().split()[1])
+        for line in f:
+            values = dict(zip(CROSS_COLUMNS, map(float, line.split())))
+            duration = values['end'] - values['start']
+            if duration <= 0:
+                continue
+            records.append({
+                'timestamp': start_time + values['end'],
+                'duration': duration,
+                'udp_mbps': values['udp_bytes'] * 8 / duration / 1e6,
+                'tcp_mbps': values['tcp_bytes'] * 8 / duration / 1e6,
+                'udp_pkts': int(values['udp_pkts']),
+                'udp_lost': int(values['udp_lost']),
+                'flows_started': int(values['flows_started']),
+                'flows_done': int(values['flows_done']),
+            })
+    return records
+
+def mean_rate(records, key):
+    total = sum(_['duration'] for _ in records)
+    return sum(_[key] * _['duration'] for _ in records) / total if total else 0
+
+def summarize_cross(sent, received, metadata):
+    """offered load of the sender against what reached the sink, UDP loss counted by the sink from sequence gaps"""
+    lost = sum(_['udp_lost'] for _ in received)
+    arrived = sum(_['udp_pkts'] for _ in received)
+    return {
+        'cross_traffic': json.dumps(metadata.get('cross_traffic')),
+        'sent_mbps': mean_rate(sent, 'udp_mbps') + mean_rate(sent, 'tcp_mbps'),
+        'delivered_mbps': mean_rate(received, 'udp_mbps') + mean_rate(received, 'tcp_mbps'),
+        'udp_sent_mbps': mean_rate(sent, 'udp_mbps'),
+        'udp_loss_rate': lost / (lost + arrived) if lost + arrived else 0,
+        'tcp_mbps': mean_rate(received, 'tcp_mbps'),
+        'flows_started': sum(_['flows_started'] for _ in sent),
+        'flows_done': sum(_['flows_done'] for _ in sent),
+    }
+
+def extract_save_cross(dirnames):
+    with open(cross_file, 'w') as f, open(cross_summary_file, 'w') as fs:
+        writer = csv.DictWriter(f, fieldnames=cross_fieldnames, extrasaction='ignore')
+        writer.writeheader()
+        summary_writer = csv.DictWriter(fs, fieldnames=summary_fieldnames)
+        summary_writer.writeheader()
+        for dirname in dirnames:
+            dirpath = os.path.join(logs_path, dirname)
+            sender_file, sink_file = os.path.join(dirpath, 'hx1_cross.log'), os.path.join(dirpath, 'hy1_cross.log')
+            if dirname == 'trash' or not log_exists(sender_file) or not log_exists(sink_file):
+                continue
+            try:
+                sent, received = extract_cross_log(sender_file), extract_cross_log(sink_file)
+            except Exception as e:
+                print_t("warning", f"error dirname: {dirname} {e}")
+                continue
+            for side, records in [('sender', sent), ('sink', received)]:
+                for record in records:
+                    writer.writerow(dict(record, experiment_id=dirname, side=side))
+            metadata = load_metadata(dirname, logs_path)
+            summary_writer.writerow(dict(summarize_cross(sent, received, metadata), experiment_id=dirname))
+
+if __name__ == '__main__':
+    extract_save_cross(os.listdir(logs_path))
@@ -0,0 +1,245 @@
+"""Summary cube over the experiment parameter grid.
+
+Every experiment is reduced to one row of summary metrics(utilization, RTT percentiles, retransmit rate,
+fairness, throughput share of every algorithm, sender cpu), keyed by its parameters(DIMENSIONS). The cube
+precomputes the mean of every metric for every combination of dimensions, rolled up dimensions hold '*',
+so any slice is a lookup instead of a pass over analysis_send.csv:
+
+    cube = build_cube()
+    table = query_cube(cube, 'share_bbr2', rows='loss', cols='delay', where={'mix': 'bbr2:1+cubic:1'})
+    export_heatmap(table, 'bbr2_share.png')
+"""
+import os
+import re
+import csv
+import json
+import itertools
+import collections
+import numpy as np
+from util import print_t
+
+logs_path = "./logs"
+send_log_file = "analysis_send.csv"
+cube_file = "analysis_cube.csv"
+summary_file = "analysis_summary.csv"
+DIMENSIONS = ['mix', 'delay', 'loss', 'bw', 'hosts', 'start_delay', 'kernel']
+METRICS = ['utilization', 'rtt_p50', 'rtt_p99', 'retrans_rate', 'fairness', 'cpu']
+ALL = '*'
+MSS = 1448 # bytes of one packet for the retransmit rate
+# algorithms a log dir name may start with, refer to the parameter strings in testbed.py
+ALGORITHMS = ['bbr', 'bbr2', 'bbr2_ecn', 'bbrplus', 'cubic', 'reno', 'copa']
+
+def parse_dirname(dirname):
+    """experiment parameters from a log dir name, for experiments without metadata.json, e.g.
+    2022-04-26-22-50-25_cubic1_bbr1_delay=40ms_loss=0_bw=100_duration=10_start_delay=0_5.13.12bbr2
+    2022-04-26-22-50-25_bbr2_ecn_2hosts_delay=40ms_...
+    """
+    parts = dirname.split('_')
+    values = dict(re.findall(r'(?:^|_)([a-z_]+)=([^_]+)', dirname))
+    # algorithm names may contain '_', so match known names instead of splitting the head on it
+    head = dirname.split('_', 1)[1].split('_delay=')[0] if '_' in dirname else ''
+    names = "|".join(sorted(ALGORITHMS, key=len, reverse=True))
+    cctypes = []
+    for cctype, hosts, count in re.findall(rf'(?:^|_)({names})(?:_(\d+)hosts|(\d+))(?=_|$)', head):
+        cctypes += [cctype] * int(hosts or count)
+    return {'cctypes': cctypes, 'delay': values.get('delay'), 'loss': values.get('loss'), 'bw': values.get('bw'),
+            'duration': values.get('duration'), 'start_delay': values.get('start_delay'), 'kernel': parts[-1]}
+
+def load_metadata(dirname, path=None):
+    """metadata.json of an experiment, or the parameters in its dir name if it has none
+
+    Args:
+        dirname (str): experiment dir name
+        path (str, optional): the logs dir. Defaults to None(logs_path).
+    """
+    metadata_file = os.path.join(path or logs_path, dirname, 'metadata.json')
+    if os.path.exists(metadata_file):
+        with open(metadata_file) as f:
+            return json.load(f)
+    return parse_dirname(dirname)
+
+def algorithm_mix(cctypes):
+    """'bbr2:1+cubic:1', algorithms in the order of the hosts running them"""
+    counts = collections.Counter(cctypes)
+    return "+".join(f"{cctype}:{counts[cctype]}" for cctype in dict.fromkeys(cctypes))
+
+def jain_index(values):
+    values = np.asarray(values, dtype=float)
+    return values.sum() ** 2 / (len(values) * (values ** 2).sum()) if len(values) and values.any() else np.nan
+
+def load_flows(filename=send_log_file):
+    """analysis_send.csv -> {experiment_id: {host: {column: np.array}}}"""
+    columns = ['bits_per_second', 'rtt', 'retransmits', 'bytes', 'cpu_us', 'end']
+    rows = collections.defaultdict(lambda: collections.defaultdict(lambda: collections.defaultdict(list)))
+    with open(filename) as f:
+        for row in csv.DictReader(f):
+            flow = rows[row['experiment_id']][row['host'].split("_")[0]]
+            for column in columns:
+                flow[column].append(float(row.get(column) or 'nan'))
+    return {experiment_id: {host: {k: np.array(v) for k, v in flow.items()} for host, flow in hosts.items()}
+            for experiment_id, hosts in rows.items()}
+
+def summarize_experiment(flows, metadata):
+    """one row of dimensions and metrics for an experiment"""
+    cctypes = metadata.get('cctypes') or []
+    senders = {_['sender']: _['cctype'] for _ in metadata.get('hosts', [])} or \
+              {f'hs{i}': cctype for i, cctype in enumerate(cctypes, 1)}
+    bw = float(metadata.get('bw') or 0)
+    throughput = {host: np.nanmean(flow['bits_per_second']) for host, flow in flows.items()}
+    rtt = np.concatenate([flow['rtt'][flow['rtt'] > 0] for flow in flows.values()])
+    retransmits = sum(np.nansum(flow['retransmits']) for flow in flows.values())
+    packets = sum(np.nansum(flow['bytes']) for flow in flows.values()) / MSS
+    elapsed = max(np.nanmax(flow['end']) for flow in flows.values())
+    cpu = sum(np.nansum(flow['cpu_us']) for flow in flows.values())
+    total = sum(throughput.values())
+
+    row = {
+        'mix': algorithm_mix(cctypes),
+        'delay': "-".join(metadata['delays']) if metadata.get('delays') else metadata.get('delay'),
+        'loss': metadata.get('loss'),
+        'bw': metadata.get('bw'),
+        'hosts': len(cctypes),
+        'start_delay': metadata.get('start_delay'),
+        'kernel': metadata.get('kernel'),
+        'utilization': total / (bw * 1e6) if bw else np.nan,
+        # iperf3 and tcpgen report rtt in usecs
+        'rtt_p50': np.percentile(rtt, 50) / 1000 if len(rtt) else np.nan,
+        'rtt_p99': np.percentile(rtt, 99) / 1000 if len(rtt) else np.nan,
+        'retrans_rate': retransmits / packets if packets else np.nan,
+        'fairness': jain_index(list(throughput.values())),
+        # sender cpu share of one core, tcpgen logs only
+        'cpu': cpu / 1e6 / elapsed if cpu and elapsed else np.nan,
+    }
+    for cctype in set(cctypes):
+        share = sum(v for host, v in throughput.items() if senders.get(host) == cctype)
+        row[f'share_{cctype}'] = share / total if total else np.nan
+    return {k: str(v) if k in DIMENSIONS else v for k, v in row.items()}
+
+def summarize_experiments(filename=send_log_file):
+    """summary rows of every experiment in analysis_send.csv"""
+    summaries = []
+    for experiment_id, flows in load_flows(filename).items():
+        try:
+            summaries.append(dict(summarize_experiment(flows, load_metadata(experiment_id)),
+                                  experiment_id=experiment_id))
+        except Exception as e:
+            print_t("warning", f"error experiment: {experiment_id} {e}")
+    return summaries
+
+def build_cube(summaries=None):
+    """mean and count of every metric for every group by over a subset of DIMENSIONS,
+    writes analysis_summary.csv and analysis_cube.csv
+
+    Returns:
+        dict: {(value or '*' for each of DIMENSIONS): {metric: mean, 'experiments': count}}
+    """
+    if summaries is None:
+        summaries = summarize_experiments()
+    metrics = METRICS + sorted({k for row in summaries for k in row if k.startswith('share_')})
+    cube = {}
+    for n in range(len(DIMENSIONS) + 1):
+        for grouped in itertools.combinations(DIMENSIONS, n):
+            groups = collections.defaultdict(list)
+            for row in summaries:
+                groups[tuple(row[_] if _ in grouped else ALL for _ in DIMENSIONS)].append(row)
+            for key, rows in groups.items():
+                cell = {'experiments': len(rows)}
+                for metric in metrics:
+                    values = np.array([row.get(metric, np.nan) for row in rows], dtype=float)
+                    cell[metric] = np.nanmean(values) if not np.isnan(values).all() else np.nan
+                cube[key] = cell
+
+    with open(summary_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=['experiment_id'] + DIMENSIONS + metrics)
+        writer.writeheader()
+        writer.writerows(summaries)
+    with open(cube_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=DIMENSIONS + ['experiments'] + metrics)
+        writer.writeheader()
+        for key, cell in cube.items():
+            writer.writerow(dict(zip(DIMENSIONS, key), **cell))
+    return cube
+
+def load_cube(filename=cube_file):
+    """read a cube written by build_cube"""
+    cube = {}
+    with open(filename) as f:
+        for row in csv.DictReader(f):
+            key = tuple(row.pop(_) for _ in DIMENSIONS)
+            cube[key] = {k: float(v) if v else np.nan for k, v in row.items()}
+    return cube
+
+def natural_key(value):
+    """sort '10ms' before '100ms' and numbers by value"""
+    m = re.match(r'[\d.]+', value)
+    return (0, float(m.group()), value) if m else (1, 0, value)
+
+def query_cube(cube, metric, rows, cols=None, where=None):
+    """slice one metric of the cube into a table, dimensions in neither rows, cols nor where are rolled up
+
+    Args:
+        cube (dict): from build_cube or load_cube
+        metric (str): e.g. 'utilization', 'share_bbr2' or 'experiments'
+        rows (str): dimension of the table rows
+        cols (str, optional): dimension of the table columns. Defaults to None(one column).
+        where (dict, optional): fixed dimension values, e.g. {'mix': 'bbr2:1+cubic:1'}. Defaults to None.
+    Returns:
+        dict: {'metric', 'rows', 'cols', 'row_values', 'col_values', 'values'(2d np.array, nan for no experiment)}
+    """
+    where = {k: str(v) for k, v in (where or {}).items()}
+    unknown = set([rows, cols] + list(where)) - set(DIMENSIONS) - {None}
+    if unknown:
+        raise ValueError(f"unknown dimensions {sorted(unknown)}, dimensions: {DIMENSIONS}")
+    cells = {}
+    for key, cell in cube.items():
+        values = dict(zip(DIMENSIONS, key))
+        if any(values[_] != where.get(_, ALL) for _ in DIMENSIONS if _ not in (rows, cols)):
+            continue
+        if values[rows] == ALL or (cols and values[cols] == ALL):
+            continue
+        cells[(values[rows], values[cols] if cols else metric)] = cell.get(metric, np.nan)
+    row_values = sorted({_[0] for _ in cells}, key=natural_key)
+    col_values = sorted({_[1] for _ in cells}, key=natural_key)
+    table = np.array([[cells.get((r, c), np.nan) for c in col_values] for r in row_values])
+    return {'metric': metric, 'rows': rows, 'cols': cols, 'row_values': row_values, 'col_values': col_values,
+            'values': table}
+
+def format_table(table):
+    width = max([len(_) for _ in table['row_values'] + table['col_values']] + [8]) + 2
+    lines = [f"{table['metric']}: {table['rows']} \\ {table['cols'] or ''}",
+             "".ljust(width) + "".join(_.rjust(width) for _ in table['col_values'])]
+    for value, row in zip(table['row_values'], table['values']):
+        lines.append(value.ljust(width) + "".join(f"{_:{width}.3f}" for _ in row))
+    return "\n".join(lines)
+
+def export_heatmap(table, filename):
+    """write a table from query_cube as a heatmap image, or as csv if filename ends with .csv"""
+    if filename.endswith('.csv'):
+        with open(filename, 'w') as f:
+            writer = csv.writer(f)
+            writer.writerow([f"{table['rows']}\\{table['cols']}"] + table['col_values'])
+            for value, row in zip(table['row_values'], table['values']):
+                writer.writerow([value] + list(row))
+        return
+    import matplotlib
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+    fig, ax = plt.subplots(figsize=(1 + 1.2 * len(table['col_values']), 1 + 0.6 * len(table['row_values'])))
+    image = ax.imshow(np.ma.masked_invalid(table['values']), cmap='viridis', aspect='auto')
+    ax.set_xticks(range(len(table['col_values'])), labels=table['col_values'])
+    ax.set_yticks(range(len(table['row_values'])), labels=table['row_values'])
+    ax.set_xlabel(table['cols'] or '')
+    ax.set_ylabel(table['rows'])
+    for (i, j), value in np.ndenumerate(table['values']):
+        if not np.isnan(value):
+            ax.text(j, i, f"{value:.2f}", ha='center', va='center', color='w')
+    fig.colorbar(image, label=table['metric'])
+    fig.tight_layout()
+    fig.savefig(filename)
+    plt.close(fig)
+
+if __name__ == '__main__':
+    cube = build_cube()
+    # e.g. how the share of bbr2 against cubic varies over loss x delay
+    table = query_cube(cube, 'share_bbr2', rows='loss', cols='delay', where={'mix': 'bbr2:1+cubic:1'})
+    print(format_table(table))
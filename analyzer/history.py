@@ -0,0 +1,226 @@
+"""Performance history of the benchmarks and regression detection.
+
+Every benchmark run is stored in the sqlite database benchmark_history.db with the git revision it ran on
+(and whether the tree had local changes) and the machine, one row per measured value:
+
+    per_ack     BbrFlow on_ack cost replaying the golden ACK trace, with and without round_aggregate
+    simulator   simulated seconds per wall second of a Dumbbell with many flows
+    pipeline    analyzer stages on synthetic logs, refer to benchmark.py
+    testbed     summary metrics of reference experiments(cube.py), record_testbed(experiment ids)
+
+detect_regressions splits the series of every metric on one machine at its change points(binary segmentation,
+permutation test of the largest mean shift) and reports the shifts to the worse side, with the revision of the
+first run after the change:
+
+    python3 analyzer/history.py                  # run per_ack, simulator and pipeline, then check
+    python3 analyzer/history.py pipeline         # run one suite, then check
+    python3 analyzer/history.py check            # only check
+"""
+import os
+import sys
+import json
+import time
+import sqlite3
+import platform
+import subprocess
+import numpy as np
+from util import print_t
+
+history_file = "benchmark_history.db"
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+GOLDEN_TRACE = "bbr_golden_trace.npz"
+REPEATS = 3 # runs of a microbenchmark, the median is kept
+# better direction of every metric
+METRICS = {
+    'us_per_ack': 'lower',
+    'sim_speed': 'higher',
+    'mb_per_s': 'higher',
+    'rows_per_s': 'higher',
+    'peak_rss_mb': 'lower',
+    'utilization': 'higher',
+    'rtt_p99': 'lower',
+    'retrans_rate': 'lower',
+    'cpu': 'lower',
+}
+
+def connect(filename=history_file):
+    db = sqlite3.connect(filename)
+    db.execute("CREATE TABLE IF NOT EXISTS runs (run_id INTEGER PRIMARY KEY, suite, timestamp, revision, dirty, "
+               "hostname, kernel, python, cpu, params)")
+    db.execute("CREATE TABLE IF NOT EXISTS results (run_id, name, metric, value, better)")
+    db.execute("CREATE INDEX IF NOT EXISTS results_run ON results (run_id)")
+    return db
+
+def git(*args):
+    try:
+        return subprocess.run(['git', '-C', REPO_DIR] + list(args), capture_output=True, text=True).stdout.strip()
+    except OSError:
+        return ''
+
+def environment():
+    cpu = platform.processor()
+    if os.path.exists('/proc/cpuinfo'):
+        with open('/proc/cpuinfo') as f:
+            cpu = next((_.split(':', 1)[1].strip() for _ in f if _.startswith('model name')), cpu)
+    return {'revision': git('rev-parse', 'HEAD'), 'dirty': int(bool(git('status', '--porcelain', '-uno'))),
+            'hostname': platform.node(), 'kernel': platform.release(), 'python': platform.python_version(),
+            'cpu': f"{cpu} x{os.cpu_count()}"}
+
+def record(suite, results, params=None, filename=history_file):
+    """store one run of a suite
+
+    Args:
+        suite (str): e.g. 'pipeline'
+        results (list): (name, metric, value) of every measurement, metrics not in METRICS are stored as 'higher'
+        params (dict, optional): scale or options of the run. Defaults to None.
+    Returns:
+        int: run id
+    """
+    db = connect(filename)
+    env = environment()
+    cursor = db.execute("INSERT INTO runs (suite, timestamp, revision, dirty, hostname, kernel, python, cpu, params) "
+                        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                        (suite, time.time(), env['revision'], env['dirty'], env['hostname'], env['kernel'],
+                         env['python'], env['cpu'], json.dumps(params or {})))
+    run_id = cursor.lastrowid
+    db.executemany("INSERT INTO results VALUES (?, ?, ?, ?, ?)",
+                   [(run_id, name, metric, float(value), METRICS.get(metric, 'higher'))
+                    for name, metric, value in results])
+    db.commit()
+    db.close()
+    print_t("info", f"{suite}: recorded {len(results)} results at {env['revision'][:10]}"
+                    f"{' (dirty)' if env['dirty'] else ''}")
+    return run_id
+
+def median_time(work):
+    times = []
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        work()
+        times.append(time.perf_counter() - start)
+    return float(np.median(times))
+
+def run_per_ack():
+    from simulator.bbr_engine import record_trace, replay_trace
+    if not os.path.exists(GOLDEN_TRACE):
+        record_trace(GOLDEN_TRACE)
+    acks = len(np.load(GOLDEN_TRACE)['flow'])
+    results = []
+    for name, round_aggregate in [('BbrFlow', False), ('BbrFlow round_aggregate', True)]:
+        seconds = median_time(lambda: replay_trace(GOLDEN_TRACE, round_aggregate=round_aggregate))
+        results.append((name, 'us_per_ack', seconds / acks * 1e6))
+    return record('per_ack', results, {'trace': GOLDEN_TRACE, 'acks': acks})
+
+def run_simulator(flows=(100, 1000), duration_s=0.5):
+    from simulator.bbr_engine import Dumbbell
+    results = []
+    for n in flows:
+        def work():
+            Dumbbell(np.full(n, 40000), bw_mbps=1000, seed=0).run(duration_s)
+        results.append((f'dumbbell {n} flows', 'sim_speed', duration_s / median_time(work)))
+    return record('simulator', results, {'flows': list(flows), 'duration_s': duration_s})
+
+def run_pipeline(**scale):
+    from benchmark import benchmark
+    results = []
+    for stage in benchmark(**scale):
+        results += [(stage['stage'], metric, stage[metric]) for metric in ['mb_per_s', 'rows_per_s', 'peak_rss_mb']]
+    return record('pipeline', results, scale)
+
+def record_testbed(experiment_ids):
+    """store the summary metrics of reference experiments, runs of the same parameters(the dir name without
+    its time) form one series
+    """
+    from cube import load_flows, summarize_experiment, load_metadata
+    flows = load_flows()
+    results = []
+    for experiment_id in experiment_ids:
+        summary = summarize_experiment(flows[experiment_id], load_metadata(experiment_id))
+        name = experiment_id.split('_', 1)[1]
+        results += [(name, metric, summary[metric]) for metric in ['utilization', 'rtt_p99', 'retrans_rate', 'cpu']
+                    if not np.isnan(summary[metric])]
+    return record('testbed', results, {'experiments': list(experiment_ids)})
+
+def max_shift(values, min_size):
+    """split index and Welch t statistic of the largest mean shift, (None, 0) if too short"""
+    n = len(values)
+    if n < 2 * min_size:
+        return None, 0
+    # means and variances of both sides of every split from prefix sums
+    k = np.arange(min_size, n - min_size + 1)
+    s1, s2 = np.cumsum(values)[k - 1], np.cumsum(values ** 2)[k - 1]
+    total1, total2 = values.sum(), (values ** 2).sum()
+    mean_a, mean_b = s1 / k, (total1 - s1) / (n - k)
+    var_a = np.maximum(s2 - k * mean_a ** 2, 0) / np.maximum(k - 1, 1)
+    var_b = np.maximum(total2 - s2 - (n - k) * mean_b ** 2, 0) / np.maximum(n - k - 1, 1)
+    scale = np.sqrt(var_a / k + var_b / (n - k))
+    # constant segments: any shift counts, relative to the magnitude of the values
+    t = np.abs(mean_a - mean_b) / np.maximum(scale, 1e-9 * (np.abs(values).mean() + 1e-12))
+    best = int(np.argmax(t))
+    return int(k[best]), float(t[best])
+
+def change_points(values, min_size=3, alpha=0.01, permutations=999, seed=0):
+    """indexes where the mean of a series shifts, binary segmentation where each split must beat the largest
+    shift of permutations shuffled copies of its segment with probability 1 - alpha
+
+    Returns:
+        list: sorted (index, p value), index is the first value after the change
+    """
+    rng = np.random.default_rng(seed)
+    values = np.asarray(values, dtype=float)
+    result = []
+    segments = [(0, len(values))]
+    while segments:
+        start, end = segments.pop()
+        segment = values[start:end]
+        k, t = max_shift(segment, min_size)
+        if k is None:
+            continue
+        exceed = sum(max_shift(rng.permutation(segment), min_size)[1] >= t for _ in range(permutations))
+        p = (exceed + 1) / (permutations + 1)
+        if p < alpha:
+            result.append((start + k, p))
+            segments += [(start, start + k), (start + k, end)]
+    return sorted(result)
+
+def detect_regressions(suite=None, min_change=0.05, alpha=0.01, min_size=3, filename=history_file):
+    """change points of every (suite, name, metric) series on one machine where the metric got worse by more
+    than min_change(relative)
+
+    Returns:
+        list: dicts with suite, name, metric, hostname, revision(first run after the change), the previous good
+            revision, mean before and after, change and p value
+    """
+    db = connect(filename)
+    query = ("SELECT r.suite, s.name, s.metric, r.hostname, s.better, r.revision, r.dirty, s.value FROM results s "
+             "JOIN runs r USING(run_id) " + ("WHERE r.suite = ? " if suite else "") + "ORDER BY r.timestamp")
+    series = {}
+    for row in db.execute(query, (suite,) if suite else ()):
+        series.setdefault(row[:5], []).append(row[5:])
+    db.close()
+
+    regressions = []
+    for (suite_name, name, metric, hostname, better), runs in series.items():
+        values = np.array([_[2] for _ in runs])
+        points = change_points(values, min_size, alpha)
+        bounds = [0] + [k for k, _ in points] + [len(values)]
+        for (k, p), start, end in zip(points, bounds, bounds[2:]):
+            before, after = values[start:k].mean(), values[k:end].mean()
+            change = (after - before) / abs(before) if before else np.inf
+            if (change < -min_change) if better == 'higher' else (change > min_change):
+                regressions.append({'suite': suite_name, 'name': name, 'metric': metric, 'hostname': hostname,
+                                    'revision': runs[k][0] + ('(dirty)' if runs[k][1] else ''),
+                                    'last_good': runs[k - 1][0], 'before': before, 'after': after,
+                                    'change': change, 'p': p})
+    return regressions
+
+SUITES = {'per_ack': run_per_ack, 'simulator': run_simulator, 'pipeline': run_pipeline}
+
+if __name__ == '__main__':
+    for suite in [_ for _ in sys.argv[1:] if _ != 'check'] or ([] if 'check' in sys.argv else list(SUITES)):
+        SUITES[suite]()
+    for regression in detect_regressions():
+        print_t("warning", f"{regression['suite']}/{regression['name']} {regression['metric']} "
+                           f"{regression['before']:.4g} -> {regression['after']:.4g} ({regression['change']:+.1%}, "
+                           f"p={regression['p']:.3f}) at {regression['revision'][:10]}, "
+                           f"last good {regression['last_good'][:10]}")
@@ -0,0 +1,71 @@
+import os
+import csv
+import struct
+import numpy as np
+from util import print_t, open_log, log_exists
+from trace_exporter import parse_queue_log
+from cube import load_metadata
+from iperf_analyzer import TCPGEN_HEADER
+
+logs_path = "./logs"
+incast_file = "analysis_incast.csv"
+incast_summary_file = "analysis_incast_summary.csv"
+# binary request records of the tools/tcpgen.c aggregator, refer to struct tcpgen_rct_record there
+RCT_RECORD = struct.Struct('<dddQII')
+incast_fieldnames = ['experiment_id', 'request', 'start', 'rct', 'first', 'bytes', 'flows']
+summary_fieldnames = ['experiment_id', 'cctype', 'flows', 'response_size', 'requests', 'rct_mean', 'rct_p50', 'rct_p99',
+                      'rct_max', 'spread_mean', 'dropped']
+
+def extract_incast_log(filename):
+    """read the request completion times written by the incast aggregator"""
+    with open_log(filename, binary=True) as f:
+        data = f.read()
+    magic, version, record_size, _, start_time = TCPGEN_HEADER.unpack_from(data)
+    if magic != b'TGEN' or record_size != RCT_RECORD.size:
+        raise ValueError(f"not a tcpgen v{version} incast file: {filename}")
+    return [dict(zip(incast_fieldnames[1:], (i,) + values[:-1]))
+            for i, values in enumerate(RCT_RECORD.iter_unpack(data[TCPGEN_HEADER.size:]))]
+
+def summarize_incast(records, metadata, dropped):
+    """tail of the request completion times, spread is the time between the first and the last response"""
+    rct = np.array([_['rct'] for _ in records])
+    return {
+        'cctype': (metadata.get('cctypes') or [''])[0],
+        'flows': records[0]['flows'],
+        'response_size': metadata.get('response_size'),
+        'requests': len(records),
+        'rct_mean': rct.mean(),
+        'rct_p50': np.percentile(rct, 50),
+        'rct_p99': np.percentile(rct, 99),
+        'rct_max': rct.max(),
+        'spread_mean': np.mean([_['rct'] - _['first'] for _ in records]),
+        'dropped': dropped,
+    }
+
+def extract_save_incast(dirnames):
+    with open(incast_file, 'w') as f, open(incast_summary_file, 'w') as fs:
+        writer = csv.DictWriter(f, fieldnames=incast_fieldnames)
+        writer.writeheader()
+        summary_writer = csv.DictWriter(fs, fieldnames=summary_fieldnames)
+        summary_writer.writeheader()
+        for dirname in dirnames:
+            dirpath = os.path.join(logs_path, dirname)
+            if dirname == 'trash' or not log_exists(os.path.join(dirpath, 'hr1_incast.bin')):
+                continue
+            try:
+                records = extract_incast_log(os.path.join(dirpath, 'hr1_incast.bin'))
+            except Exception as e:
+                print_t("warning", f"error dirname: {dirname} {e}")
+                continue
+            if not records:
+                continue
+            for record in records:
+                writer.writerow(dict(record, experiment_id=dirname))
+            metadata = load_metadata(dirname, logs_path)
+            queue_file = os.path.join(dirpath, 'queue_final.log')
+            queue = parse_queue_log(queue_file) if log_exists(queue_file) else []
+            dropped = queue[-1][3] if queue else ''
+            summary_writer.writerow(dict(summarize_incast(records, metadata, dropped), experiment_id=dirname))
+
+if __name__ == '__main__':
+    extract_save_incast(os.listdir(logs_path))
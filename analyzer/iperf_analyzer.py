@@ -1,14 +1,20 @@
 import json
 import csv
 import os
-from util import print_t
+import struct
+from util import print_t, open_log, log_name
 
 rec_log_file = "analysis_rec.csv"
 send_log_file = "analysis_send.csv"
 logs_path = "./logs"
+# binary stats of tools/tcpgen.c, refer to struct tcpgen_header and struct tcpgen_record there
+TCPGEN_HEADER = struct.Struct('<4sIIId')
+TCPGEN_RECORD = struct.Struct('<ddQQQIIIIII')
+TCPGEN_FIELDS = ['start', 'end', 'bytes', 'pacing_rate', 'delivery_rate', 'snd_cwnd', 'rtt', 'rttvar', 'retransmits',
+                 'cpu_us', 'unused']
 
 def extract_iperf_rec_log(filename):
-    with open(filename) as f:
+    with open_log(filename) as f:
         content = f.readlines()
         if content[-11] == "{\n":
             content = content[:-11]
@@ -24,7 +30,7 @@ def extract_iperf_rec_log(filename):
     return records[n:]
 
 def extract_iperf_send_log(filename):
-    with open(filename) as f:
+    with open_log(filename) as f:
         content = f.readlines()
         if content[-11] == "{\n":
             content = content[:-11]
@@ -35,10 +41,30 @@ def extract_iperf_send_log(filename):
     n = 0
     return records[n:]
 
+def extract_tcpgen_log(filename):
+    """read the binary stats of a tcpgen sender or receiver into records like the iperf3 ones"""
+    with open_log(filename, binary=True) as f:
+        data = f.read()
+    magic, version, record_size, role, _ = TCPGEN_HEADER.unpack_from(data)
+    if magic != b'TGEN' or record_size != TCPGEN_RECORD.size:
+        raise ValueError(f"not a tcpgen v{version} stats file: {filename}")
+    records = []
+    for values in TCPGEN_RECORD.iter_unpack(data[TCPGEN_HEADER.size:]):
+        record = dict(zip(TCPGEN_FIELDS, values))
+        del record['unused']
+        record['seconds'] = record['end'] - record['start']
+        record['bits_per_second'] = record['bytes'] * 8 / record['seconds'] if record['seconds'] else 0
+        record['sender'] = role == 1 # enum role in tcpgen.c
+        if role != 1:
+            # tcp_info of the receiving socket says nothing about the flow
+            record = {k: record[k] for k in ['start', 'end', 'seconds', 'bytes', 'bits_per_second', 'sender']}
+        records.append(record)
+    return records
 
 def extract_save_send_log(dirnames):
     #write the header first
-    send_fieldnames = ['experiment_id', 'host', 'start', 'bytes', 'bits_per_second', 'retransmits', 'snd_cwnd', 'snd_wnd', 'rtt', 'rttvar', 'socket', 'end', 'seconds', 'omitted', 'pmtu', 'sender']
+    send_fieldnames = ['experiment_id', 'host', 'start', 'bytes', 'bits_per_second', 'retransmits', 'snd_cwnd', 'snd_wnd', 'rtt', 'rttvar', 'socket', 'end', 'seconds', 'omitted', 'pmtu', 'sender',
+                       'pacing_rate', 'delivery_rate', 'cpu_us']
     with open(send_log_file, 'w') as f:
         writer = csv.DictWriter(f, fieldnames=send_fieldnames)
         writer.writeheader()
@@ -50,12 +76,13 @@ def extract_save_send_log(dirnames):
             filenames = [filename for filename in filenames if filename[:2] == "hs"]
             for filename in filenames:
                 try:
-                    records = extract_iperf_send_log(os.path.join(logs_path, dirname, filename))
-                except:
-                    print_t("warning", f"error filename: {dirname}/{filename}")
+                    path = os.path.join(logs_path, dirname, filename)
+                    records = extract_tcpgen_log(path) if '_tcpgen' in filename else extract_iperf_send_log(path)
+                except Exception as e:
+                    print_t("warning", f"error filename: {dirname}/{filename} {e}")
                     continue
                 for record in records:
-                    record['host'] = filename
+                    record['host'] = log_name(filename)
                     record['experiment_id'] = dirname
                     writer.writerow(record)
 
@@ -70,15 +97,18 @@ def extract_save_rec_log(dirnames):
             if dirname == 'trash':
                 continue
             filenames = os.listdir(os.path.join(logs_path, dirname))
-            filenames = [filename for filename in filenames if filename[:2] == "hr"]
+            # hr1_incast.bin is read by incast_analyzer.py, hr*_video.bin by video_analyzer.py
+            filenames = [filename for filename in filenames
+                         if filename[:2] == "hr" and '_incast' not in filename and '_video' not in filename]
             for filename in filenames:
                 try:
-                    records = extract_iperf_rec_log(os.path.join(logs_path, dirname, filename))
-                except:
-                    print_t("warning", f"error filename: {dirname}/{filename}")
+                    path = os.path.join(logs_path, dirname, filename)
+                    records = extract_tcpgen_log(path) if '_tcpgen' in filename else extract_iperf_rec_log(path)
+                except Exception as e:
+                    print_t("warning", f"error filename: {dirname}/{filename} {e}")
                     continue
                 for record in records:
-                    record['host'] = filename
+                    record['host'] = log_name(filename)
                     record['experiment_id'] = dirname
                     
                     writer.writerow(record)
@@ -0,0 +1,156 @@
+"""SQL over the analysis tables.
+
+The analysis csv files are loaded into one sqlite database(analysis.db), one table per file and an
+experiments table with the parameters of every experiment(from metadata.json or the dir name). Every table
+is indexed by experiment and time, so conditions on the experiment parameters and time ranges only read
+the matching rows instead of every csv from the beginning:
+
+    python3 analyzer/query.py "SELECT e.mix, e.loss, avg(s.bits_per_second) FROM send s
+                               JOIN experiments e USING(experiment_id) WHERE e.delay = '40ms' AND s.start < 10
+                               GROUP BY e.mix, e.loss"
+
+Loading is incremental: unchanged csv files are skipped, the experiments of a changed one replace their
+rows(and parameters) from the earlier load and the experiments no longer in it(moved to trash or deleted) are
+dropped, run `python3 analyzer/query.py` without a query to only load.
+"""
+import os
+import sys
+import csv
+import json
+import sqlite3
+from util import print_t
+from cube import load_metadata, algorithm_mix
+
+database_file = "analysis.db"
+# table: (csv file, time column)
+TABLES = {
+    'send': ("analysis_send.csv", 'start'),
+    'rec': ("analysis_rec.csv", 'start'),
+    'second': ("analysis_second.csv", 'timestamp'),
+    'microsecond': ("analysis_microsecond.csv", 'timestamp'),
+}
+EXPERIMENT_COLUMNS = ['experiment_id', 'mix', 'cctypes', 'delay', 'loss', 'bw', 'hosts', 'duration', 'start_delay',
+                      'kernel', 'metadata']
+INDEXED_PARAMETERS = ['mix', 'delay', 'loss', 'bw', 'hosts', 'kernel']
+
+def convert(value):
+    """csv text to a sqlite value, numbers compare as numbers"""
+    if value == '':
+        return None
+    for kind in (int, float):
+        try:
+            return kind(value)
+        except ValueError:
+            pass
+    return value
+
+def connect(filename=database_file):
+    db = sqlite3.connect(filename)
+    db.execute("CREATE TABLE IF NOT EXISTS sources (file TEXT PRIMARY KEY, mtime REAL)")
+    db.execute(f"CREATE TABLE IF NOT EXISTS experiments ({', '.join(EXPERIMENT_COLUMNS)}, "
+               "PRIMARY KEY (experiment_id))")
+    for column in INDEXED_PARAMETERS:
+        db.execute(f"CREATE INDEX IF NOT EXISTS experiments_{column} ON experiments ({column})")
+    return db
+
+def add_experiment(db, experiment_id):
+    """(re)load the parameters of an experiment, its metadata.json may have changed since the last load"""
+    db.execute("DELETE FROM experiments WHERE experiment_id = ?", (experiment_id,))
+    metadata = load_metadata(experiment_id)
+    cctypes = metadata.get('cctypes') or []
+    row = {
+        'experiment_id': experiment_id,
+        'mix': algorithm_mix(cctypes),
+        'cctypes': ",".join(cctypes),
+        'delay': "-".join(metadata['delays']) if metadata.get('delays') else metadata.get('delay'),
+        'loss': convert(str(metadata.get('loss', ''))),
+        'bw': convert(str(metadata.get('bw', ''))),
+        'hosts': len(cctypes),
+        'duration': convert(str(metadata.get('duration', ''))),
+        'start_delay': convert(str(metadata.get('start_delay', ''))),
+        'kernel': metadata.get('kernel'),
+        'metadata': json.dumps(metadata),
+    }
+    db.execute(f"INSERT INTO experiments VALUES ({', '.join('?' * len(EXPERIMENT_COLUMNS))})",
+               [row[_] for _ in EXPERIMENT_COLUMNS])
+
+def load_table(db, table, filename, time_column):
+    """load the rows of every experiment in filename, replacing the rows an earlier load left for it. The
+    analyzers rewrite the csv from scratch, so rows of experiments no longer in it are deleted
+    """
+    with open(filename) as f:
+        reader = csv.reader(f)
+        header = next(reader)
+        db.execute(f"CREATE TABLE IF NOT EXISTS {table} ({', '.join(header)})")
+        columns = [_[1] for _ in db.execute(f"PRAGMA table_info({table})")]
+        for column in header:
+            if column not in columns:
+                db.execute(f"ALTER TABLE {table} ADD COLUMN {column}")
+        db.execute(f"CREATE INDEX IF NOT EXISTS {table}_experiment ON {table} (experiment_id, {time_column})")
+        insert = f"INSERT INTO {table} ({', '.join(header)}) VALUES ({', '.join('?' * len(header))})"
+        experiment = header.index('experiment_id')
+        added = set()
+        for row in reader:
+            if row[experiment] not in added:
+                # the experiment was analyzed again, drop the stale rows
+                db.execute(f"DELETE FROM {table} WHERE experiment_id = ?", (row[experiment],))
+                add_experiment(db, row[experiment])
+                added.add(row[experiment])
+            db.execute(insert, [convert(_) for _ in row])
+    stale = {_[0] for _ in db.execute(f"SELECT DISTINCT experiment_id FROM {table}")} - added
+    for experiment_id in stale:
+        db.execute(f"DELETE FROM {table} WHERE experiment_id = ?", (experiment_id,))
+    return len(added)
+
+def drop_orphans(db):
+    """delete the parameters of experiments without rows in any table"""
+    tables = [_[0] for _ in db.execute("SELECT name FROM sqlite_master WHERE type = 'table'")
+              if _[0] in TABLES]
+    if not tables:
+        return
+    used = " UNION ".join(f"SELECT experiment_id FROM {_}" for _ in tables)
+    db.execute(f"DELETE FROM experiments WHERE experiment_id NOT IN ({used})")
+
+def update(db, verbose=True):
+    """load the analysis csv files changed since the last load, statistics are refreshed so that
+    the planner starts from the experiments table when a query selects a few experiments
+    """
+    for table, (filename, time_column) in TABLES.items():
+        if not os.path.exists(filename):
+            continue
+        mtime = os.path.getmtime(filename)
+        if db.execute("SELECT 1 FROM sources WHERE file = ? AND mtime = ?", (filename, mtime)).fetchone():
+            continue
+        try:
+            added = load_table(db, table, filename, time_column)
+            drop_orphans(db)
+        except Exception as e:
+            print_t("warning", f"error loading {filename}: {e}")
+            db.rollback()
+            continue
+        db.execute("INSERT OR REPLACE INTO sources VALUES (?, ?)", (filename, mtime))
+        db.execute("ANALYZE")
+        db.commit()
+        if verbose:
+            print_t("info", f"{table}: loaded {added} experiments from {filename}")
+
+def query(sql, params=(), filename=database_file):
+    """run sql on the up to date store, returns (column names, rows)"""
+    db = connect(filename)
+    update(db, verbose=False)
+    cursor = db.execute(sql, params)
+    columns = [_[0] for _ in cursor.description] if cursor.description else []
+    rows = cursor.fetchall()
+    db.close()
+    return columns, rows
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        db = connect()
+        update(db)
+        db.close()
+    else:
+        columns, rows = query(" ".join(sys.argv[1:]))
+        writer = csv.writer(sys.stdout, delimiter='\t')
+        writer.writerow(columns)
+        writer.writerows(rows)
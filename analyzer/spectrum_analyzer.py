@@ -0,0 +1,134 @@
+import csv
+import collections
+import itertools
+import numpy as np
+
+spectrum_file = "analysis_spectrum.csv"
+sync_file = "analysis_sync.csv"
+METRICS = ['bits_per_second', 'rtt', 'snd_cwnd']
+BBR_CYCLE_LEN = 8 # phases of bbr ProbeBW gain cycle, one min_rtt each
+PROBE_RTT_INTERVAL = 10 # seconds between bbr ProbeRTT
+spectrum_fieldnames = ['experiment_id', 'host', 'metric', 'samples', 'interval', 'dominant_period', 'dominant_amplitude',
+                       'dominant_share', 'gain_cycle_period', 'gain_cycle_share', 'probe_rtt_share']
+sync_fieldnames = ['experiment_id', 'flows', 'mean_corr', 'max_corr', 'common_period']
+
+def load_series(filename='analysis_send.csv'):
+    """read the iperf sender records, return {experiment_id: {host: {metric: np.array}}} sorted by time"""
+    rows = collections.defaultdict(lambda: collections.defaultdict(list))
+    for row in csv.DictReader(open(filename)):
+        host = row['host'].split("_")[0]
+        rows[row['experiment_id']][host].append(row)
+
+    result = collections.defaultdict(dict)
+    for experiment_id, hosts in rows.items():
+        for host, host_rows in hosts.items():
+            host_rows = sorted(host_rows, key=lambda x: float(x['start']))
+            series = {'start': np.array([float(_['start']) for _ in host_rows])}
+            for metric in METRICS:
+                series[metric] = np.array([float(_[metric] or 0) for _ in host_rows])
+            result[experiment_id][host] = series
+    return result
+
+def periodogram(values, interval):
+    """Hann windowed periodogram of a detrended series
+
+    Args:
+        values (np.array): evenly sampled series
+        interval (float): sample interval in seconds
+    Returns:
+        (freqs, power, amplitude) without the zero frequency bin, amplitude is the peak amplitude
+        of a sine at that frequency in the unit of values
+    """
+    n = len(values)
+    t = np.arange(n)
+    values = values - np.polyval(np.polyfit(t, values, 1), t)
+    window = np.hanning(n)
+    spectrum = np.fft.rfft(values * window)
+    freqs = np.fft.rfftfreq(n, d=interval)
+    power = np.abs(spectrum) ** 2
+    amplitude = 2 * np.abs(spectrum) / window.sum()
+    return freqs[1:], power[1:], amplitude[1:]
+
+def band_share(freqs, power, period, tolerance=0.2):
+    """share of the total power within period * (1 +- tolerance), 0 if period can't be resolved"""
+    if not period or period < 1 / freqs[-1] or period > 1 / freqs[0]:
+        return 0
+    band = (freqs >= 1 / (period * (1 + tolerance))) & (freqs <= 1 / (period * (1 - tolerance)))
+    return power[band].sum() / power.sum() if power.sum() else 0
+
+def analyze_flow(series, metric, min_samples=32):
+    """dominant oscillation of one metric of one flow, None if the series is too short"""
+    values = series[metric]
+    if len(values) < min_samples or values.std() == 0:
+        return None
+    interval = float(np.median(np.diff(series['start'])))
+    freqs, power, amplitude = periodogram(values, interval)
+    peak = int(np.argmax(power))
+    # iperf reports rtt in microsecond
+    min_rtt = series['rtt'][series['rtt'] > 0].min() / 1e6 if (series['rtt'] > 0).any() else 0
+    gain_cycle_period = BBR_CYCLE_LEN * min_rtt
+    return {
+        'samples': len(values),
+        'interval': interval,
+        'dominant_period': 1 / freqs[peak],
+        'dominant_amplitude': amplitude[peak],
+        'dominant_share': power[peak] / power.sum() if power.sum() else 0,
+        'gain_cycle_period': gain_cycle_period,
+        'gain_cycle_share': band_share(freqs, power, gain_cycle_period),
+        'probe_rtt_share': band_share(freqs, power, PROBE_RTT_INTERVAL),
+    }
+
+def analyze_sync(hosts, metric='bits_per_second', min_samples=32):
+    """correlation between the flows of one experiment, in phase oscillations give a high positive correlation.
+    Flows are aligned on their iperf interval start times, so they should start at the same time(start_delay=0)
+    """
+    flows = {host: series for host, series in hosts.items() if len(series[metric]) >= min_samples}
+    if len(flows) < 2:
+        return None
+    length = min(len(_[metric]) for _ in flows.values())
+    aligned = {}
+    for host, series in flows.items():
+        values = series[metric][:length]
+        t = np.arange(length)
+        aligned[host] = values - np.polyval(np.polyfit(t, values, 1), t)
+
+    corrs = []
+    for a, b in itertools.combinations(sorted(aligned), 2):
+        if aligned[a].std() == 0 or aligned[b].std() == 0:
+            continue
+        corrs.append(np.corrcoef(aligned[a], aligned[b])[0, 1])
+    # the period all flows oscillate together at, from the product of their spectra
+    interval = float(np.median(np.diff(next(iter(flows.values()))['start'])))
+    common = None
+    for values in aligned.values():
+        freqs, power, _ = periodogram(values, interval)
+        common = power if common is None else common * power / power.max()
+    return {
+        'flows': len(flows),
+        'mean_corr': float(np.mean(corrs)) if corrs else 0,
+        'max_corr': float(np.max(corrs)) if corrs else 0,
+        'common_period': 1 / freqs[int(np.argmax(common))],
+    }
+
+def extract_save_spectrum(filename='analysis_send.csv'):
+    experiments = load_series(filename)
+    with open(spectrum_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=spectrum_fieldnames)
+        writer.writeheader()
+        for experiment_id, hosts in experiments.items():
+            for host, series in hosts.items():
+                for metric in METRICS:
+                    record = analyze_flow(series, metric)
+                    if record:
+                        writer.writerow(dict(record, experiment_id=experiment_id, host=host, metric=metric))
+
+    with open(sync_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=sync_fieldnames)
+        writer.writeheader()
+        for experiment_id, hosts in experiments.items():
+            record = analyze_sync(hosts)
+            if record:
+                writer.writerow(dict(record, experiment_id=experiment_id))
+
+if __name__ == '__main__':
+    extract_save_spectrum()
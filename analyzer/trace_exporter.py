@@ -0,0 +1,250 @@
+import os
+import re
+import json
+from util import print_t, open_log, log_exists
+from cross_analyzer import extract_cross_log
+
+logs_path = "./logs"
+trace_path = "./traces"
+BBR2_PHASES = ['PROBE_BW up', 'PROBE_BW down', 'PROBE_BW cruise', 'PROBE_BW refill']
+BBR2_MODES = {'G': 'STARTUP', 'D': 'DRAIN', 'M': 'PROBE_RTT'}
+# bbr2 debug events worth a marker on the timeline, refer to bbr->debug.event in bbr2.c
+BBR2_EVENTS = {'L': 'loss/ECN too high, inflight_hi cut', 'E': 'ECN STARTUP exit', 'P': 'loss STARTUP exit',
+               'R': 'reprobe', 'U': 'raise inflight_hi', 'A': 'probe again', 'T': 'route change, min_rtt reset',
+               'F': 'capacity freed, probe early'}
+RATE_UNITS = {'': 1, 'K': 1e3, 'M': 1e6, 'G': 1e9}
+
+def read_samples(filename):
+    """split a ss/tc sample log into (epoch time, lines) by the '# <time>' lines"""
+    samples = []
+    with open_log(filename) as f:
+        for line in f:
+            if line.startswith('# '):
+                samples.append((float(line.split()[1]), []))
+            elif samples:
+                samples[-1][1].append(line)
+    return samples
+
+def parse_rate(rate):
+    """'122.5Mbps' -> 122500000.0"""
+    m = re.match(r'([\d.]+)([KMG]?)bps', rate)
+    return float(m.group(1)) * RATE_UNITS[m.group(2)] if m else 0
+
+def parse_ss_log(filename):
+    """read tcp_info samples of one sender, keep the iperf data socket(the one with most bytes acked)"""
+    records = []
+    for timestamp, lines in read_samples(filename):
+        best = None
+        for line in lines:
+            if 'cwnd:' not in line:
+                continue
+            acked = re.search(r'bytes_acked:(\d+)', line)
+            acked = int(acked.group(1)) if acked else 0
+            if best is None or acked > best[0]:
+                best = (acked, line)
+        if best is None:
+            continue
+        line = best[1]
+        record = {'timestamp': timestamp, 'cwnd': int(re.search(r'cwnd:(\d+)', line).group(1))}
+        m = re.search(r'pacing_rate ([\d.]+[KMG]?bps)', line)
+        record['pacing_rate'] = parse_rate(m.group(1)) if m else 0
+        m = re.search(r' rtt:([\d.]+)/', line)
+        record['rtt'] = float(m.group(1)) if m else 0
+        m = re.search(r'retrans:\d+/(\d+)', line)
+        record['retrans'] = int(m.group(1)) if m else 0
+        m = re.search(r'bbr:\(([^)]*)\)', line)
+        if m:
+            fields = dict(_.split(':', 1) for _ in m.group(1).split(',') if ':' in _)
+            record['pacing_gain'] = float(fields.get('pacing_gain', 0))
+            record['bw'] = parse_rate(fields.get('bw', ''))
+        records.append(record)
+    return records
+
+def bbr_state(record):
+    """infer the bbr mode and ProbeBW phase from the pacing gain reported by ss, None if not a bbr flow"""
+    gain = record.get('pacing_gain')
+    if gain is None:
+        return None
+    if gain > 2:
+        return 'STARTUP'
+    if gain < 0.5:
+        return 'DRAIN'
+    if gain > 1.1:
+        return 'PROBE_BW up'
+    if gain < 0.95:
+        return 'PROBE_BW down'
+    # bbr v1 holds cwnd at 4 packets in ProbeRTT with unit gain
+    if record['cwnd'] <= 4:
+        return 'PROBE_RTT'
+    return 'PROBE_BW cruise'
+
+def parse_queue_log(filename):
+    """read the root qdisc backlog of the bottleneck, [(time, bytes, packets, dropped)]"""
+    records = []
+    for timestamp, lines in read_samples(filename):
+        text = ''.join(lines)
+        backlog = re.search(r'backlog (\d+)([KM]?)b (\d+)p', text)
+        dropped = re.search(r'dropped (\d+)', text)
+        if backlog:
+            size = int(backlog.group(1)) * {'': 1, 'K': 1024, 'M': 1024 * 1024}[backlog.group(2)]
+            records.append((timestamp, size, int(backlog.group(3)), int(dropped.group(1)) if dropped else 0))
+    return records
+
+def debug_senders(hosts, addresses=None):
+    """receiver address -> sender host, the bbr2 debug lines only name the peer of a flow
+
+    Args:
+        hosts (list): 'hosts' of metadata.json
+        addresses (dict, optional): 'addresses' of metadata.json, {host: ip}. Defaults to None(experiments
+            recorded before it was saved: mininet numbers hosts in natural sorted order, so hr1..hrN come first
+            and get 10.0.0.1..N).
+    """
+    if not addresses:
+        receivers = sorted({_.get('receiver', f"hr{i}") for i, _ in enumerate(hosts, 1)}, key=lambda _: int(_[2:]))
+        addresses = {receiver: f"10.0.0.{i}" for i, receiver in enumerate(receivers, 1)}
+    senders = {}
+    for i, host in enumerate(hosts, 1):
+        # incast responders share one receiver, the first one keeps its debug lines
+        senders.setdefault(addresses[host.get('receiver', f"hr{i}")], host['sender'])
+    return senders
+
+def parse_bbr2_debug(filename, senders):
+    """read bbr2 printk debug lines(bbr2_debug_msg in bbr2.c) captured from dmesg
+
+    Args:
+        filename (str): the bbr2_debug.log under the experiment dir
+        senders (dict): {receiver address: sender host}, refer to debug_senders
+    Returns:
+        dict: {sender host: [records]}
+    """
+    result = {}
+    with open_log(filename) as f:
+        header = f.readline().split()
+        epoch, uptime = float(header[1]), float(header[2])
+        for line in f:
+            m = re.match(r'\[\s*([\d.]+)\]\s+BBR (.*)', line)
+            if not m or float(m.group(1)) < uptime:
+                continue
+            tokens = m.group(2).split()
+            # tokens: daddr:dport una:fack ca_state mode cwnd key value ...
+            fields = {tokens[i]: tokens[i + 1] for i in range(5, len(tokens) - 1)}
+            version = tokens.index('v')
+            host = senders.get(tokens[0].split(':')[0])
+            if host is None:
+                continue
+            mode = tokens[3]
+            if mode == '@': # undo, mode not printed
+                continue
+            record = {
+                'timestamp': epoch + float(m.group(1)) - uptime,
+                'state': BBR2_MODES.get(mode) or BBR2_PHASES[int(tokens[version + 3])],
+                'cwnd': int(tokens[4]),
+                'pacing_rate': int(fields.get('qb', 0)) * 1000,
+                'inflight_hi': int(fields.get('ih', 0)),
+                'inflight_lo': int(fields.get('il', 0)),
+                'loss_rate': int(fields.get('lr', 0)) / 1000,
+                'ecn_rate': int(fields.get('er', 0)) / 1000,
+                'event': tokens[version + 2],
+            }
+            result.setdefault(host, []).append(record)
+    return result
+
+def state_spans(records, pid, tid):
+    """merge consecutive records of the same state into complete('X') events"""
+    events = []
+    start = None
+    for record, following in zip(records, records[1:] + [None]):
+        if start is None:
+            start = record
+        if following is None or following['state'] != start['state']:
+            end = following['timestamp'] if following else record['timestamp']
+            events.append({'name': start['state'], 'ph': 'X', 'pid': pid, 'tid': tid,
+                           'ts': start['timestamp'] * 1e6, 'dur': (end - start['timestamp']) * 1e6})
+            start = None
+    return events
+
+def counter(name, pid, timestamp, **values):
+    return {'name': name, 'ph': 'C', 'pid': pid, 'ts': timestamp * 1e6, 'args': values}
+
+def instant(name, pid, tid, timestamp, **args):
+    return {'name': name, 'ph': 'i', 's': 't', 'pid': pid, 'tid': tid, 'ts': timestamp * 1e6, 'args': args}
+
+def build_trace(dirname):
+    """convert the state logs of one experiment into chrome trace events,
+    one process per experiment, one thread(track) per flow and one track for the bottleneck queue
+    """
+    dirpath = os.path.join(logs_path, dirname)
+    metadata_file = os.path.join(dirpath, 'metadata.json')
+    addresses = None
+    if os.path.exists(metadata_file):
+        with open(metadata_file) as f:
+            metadata = json.load(f)
+        hosts, addresses = metadata['hosts'], metadata.get('addresses')
+    else:
+        n = len([_ for _ in os.listdir(dirpath) if _.startswith('ss_hs')])
+        hosts = [{'sender': f'hs{i}', 'cctype': ''} for i in range(1, n + 1)]
+    pid = 1
+    events = [{'name': 'process_name', 'ph': 'M', 'pid': pid, 'args': {'name': dirname}}]
+
+    debug_file = os.path.join(dirpath, 'bbr2_debug.log')
+    debug = parse_bbr2_debug(debug_file, debug_senders(hosts, addresses)) if log_exists(debug_file) else {}
+    for tid, host in enumerate(hosts, 1):
+        sender = host['sender']
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': pid, 'tid': tid,
+                       'args': {'name': f"{sender} {host['cctype']}"}})
+        ss_file = os.path.join(dirpath, f'ss_{sender}.log')
+        records = parse_ss_log(ss_file) if log_exists(ss_file) else []
+        for record in records:
+            events.append(counter(f'{sender} cwnd', pid, record['timestamp'], cwnd=record['cwnd']))
+            events.append(counter(f'{sender} pacing_rate', pid, record['timestamp'], bps=record['pacing_rate']))
+            events.append(counter(f'{sender} rtt', pid, record['timestamp'], ms=record['rtt']))
+        for record, previous in zip(records[1:], records):
+            if record['retrans'] > previous['retrans']:
+                events.append(instant('retransmit', pid, tid, record['timestamp'],
+                                      packets=record['retrans'] - previous['retrans']))
+
+        # bbr2 debug lines know the exact state, otherwise infer it from pacing gain
+        if debug.get(sender):
+            states = debug[sender]
+            for record in states:
+                events.append(counter(f'{sender} inflight_hi', pid, record['timestamp'], packets=record['inflight_hi']))
+                if record['event'] in BBR2_EVENTS:
+                    events.append(instant(BBR2_EVENTS[record['event']], pid, tid, record['timestamp'],
+                                          loss_rate=record['loss_rate'], ecn_rate=record['ecn_rate'],
+                                          inflight_hi=record['inflight_hi']))
+        else:
+            states = [dict(_, state=bbr_state(_)) for _ in records if bbr_state(_)]
+        events.extend(state_spans(states, pid, tid))
+
+    for side, name in [('hx1', 'cross sent'), ('hy1', 'cross delivered')]:
+        cross_file = os.path.join(dirpath, f'{side}_cross.log')
+        for record in extract_cross_log(cross_file) if log_exists(cross_file) else []:
+            events.append(counter(name, pid, record['timestamp'], udp_mbps=record['udp_mbps'],
+                                  tcp_mbps=record['tcp_mbps']))
+
+    queue_file = os.path.join(dirpath, 'queue.log')
+    if log_exists(queue_file):
+        for timestamp, size, packets, dropped in parse_queue_log(queue_file):
+            events.append(counter('bottleneck queue', pid, timestamp, bytes=size, packets=packets))
+            events.append(counter('bottleneck dropped', pid, timestamp, packets=dropped))
+    return events
+
+def export_traces(dirnames):
+    """write traces/<experiment>.json, open them in https://ui.perfetto.dev or chrome://tracing"""
+    os.makedirs(trace_path, exist_ok=True)
+    for dirname in dirnames:
+        if dirname == 'trash':
+            continue
+        dirpath = os.path.join(logs_path, dirname)
+        if not any(_.startswith('ss_hs') for _ in os.listdir(dirpath)):
+            continue
+        try:
+            events = build_trace(dirname)
+        except Exception as e:
+            print_t("warning", f"error dirname: {dirname} {e}")
+            continue
+        with open(os.path.join(trace_path, f"{dirname}.json"), 'w') as f:
+            json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+
+if __name__ == '__main__':
+    export_traces(os.listdir(logs_path))
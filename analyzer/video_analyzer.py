@@ -0,0 +1,79 @@
+import os
+import csv
+import struct
+import numpy as np
+from util import print_t, open_log, log_name
+from cube import load_metadata
+from iperf_analyzer import TCPGEN_HEADER
+
+logs_path = "./logs"
+video_file = "analysis_video.csv"
+video_summary_file = "analysis_video_summary.csv"
+# binary segment records of the tools/tcpgen.c player, refer to struct tcpgen_chunk_record there
+CHUNK_RECORD = struct.Struct('<ddddQII')
+video_fieldnames = ['experiment_id', 'host', 'segment', 'start', 'download', 'buffer', 'stall', 'bytes', 'bitrate']
+summary_fieldnames = ['experiment_id', 'host', 'cctype', 'segments', 'bitrate_mean', 'switches', 'startup_delay',
+                      'stalls', 'stall_time', 'rebuffer_ratio', 'download_mean', 'download_p95']
+
+def extract_video_log(filename):
+    """read the segments downloaded by a video player, bitrate in kbps"""
+    with open_log(filename, binary=True) as f:
+        data = f.read()
+    magic, version, record_size, _, start_time = TCPGEN_HEADER.unpack_from(data)
+    if magic != b'TGEN' or record_size != CHUNK_RECORD.size:
+        raise ValueError(f"not a tcpgen v{version} video file: {filename}")
+    return [dict(zip(video_fieldnames[2:], (i,) + values[:-1]))
+            for i, values in enumerate(CHUNK_RECORD.iter_unpack(data[TCPGEN_HEADER.size:]))]
+
+def summarize_video(records, cctype):
+    """quality of experience of one player, the stall of the first segment is the startup delay and
+    the rebuffer ratio is the stall time over the time played after it
+    """
+    stalls = np.array([_['stall'] for _ in records[1:]])
+    bitrates = np.array([_['bitrate'] for _ in records])
+    downloads = np.array([_['download'] for _ in records])
+    played = records[-1]['start'] + records[-1]['download'] - records[0]['download']
+    return {
+        'cctype': cctype,
+        'segments': len(records),
+        'bitrate_mean': bitrates.mean(),
+        'switches': int(np.count_nonzero(np.diff(bitrates))),
+        'startup_delay': records[0]['stall'],
+        'stalls': int(np.count_nonzero(stalls)),
+        'stall_time': stalls.sum(),
+        'rebuffer_ratio': stalls.sum() / played if played > 0 else 0,
+        'download_mean': downloads.mean(),
+        'download_p95': np.percentile(downloads, 95),
+    }
+
+def extract_save_video(dirnames):
+    with open(video_file, 'w') as f, open(video_summary_file, 'w') as fs:
+        writer = csv.DictWriter(f, fieldnames=video_fieldnames)
+        writer.writeheader()
+        summary_writer = csv.DictWriter(fs, fieldnames=summary_fieldnames)
+        summary_writer.writeheader()
+        for dirname in dirnames:
+            if dirname == 'trash':
+                continue
+            dirpath = os.path.join(logs_path, dirname)
+            filenames = [_ for _ in os.listdir(dirpath) if '_video.bin' in _]
+            if not filenames:
+                continue
+            metadata = load_metadata(dirname, logs_path)
+            cctypes = {_['receiver']: _['cctype'] for _ in metadata.get('hosts', [])}
+            for filename in filenames:
+                host = log_name(filename)
+                try:
+                    records = extract_video_log(os.path.join(dirpath, filename))
+                except Exception as e:
+                    print_t("warning", f"error filename: {dirname}/{filename} {e}")
+                    continue
+                if not records:
+                    continue
+                for record in records:
+                    writer.writerow(dict(record, experiment_id=dirname, host=host))
+                summary_writer.writerow(dict(summarize_video(records, cctypes.get(host.split('_')[0], '')),
+                                             experiment_id=dirname, host=host))
+
+if __name__ == '__main__':
+    extract_save_video(os.listdir(logs_path))
@@ -64,6 +64,7 @@
 #include <linux/random.h>
 
 #include "tcp_dctcp.h"
+#include "bbr2_model.h"
 
 /* Scale factor for rate in pkt/uSec unit to avoid truncation in bandwidth
  * estimation. The rate unit ~= (1500 bytes / 1 usec / 2^24) ~= 715 bps.
@@ -116,7 +117,13 @@ struct bbr {
 		ce_state:1,          /* If most recent data has CE bit set */
 		bw_probe_up_rounds:5,   /* cwnd-limited rounds in PROBE_UP */
 		try_fast_path:1, 	/* can we take fast path? */
-		unused2:11,
+		min_rtt_shift_cnt:3,	/* rounds with RTT floor above min_rtt */
+		round_rtt_shifted:1,	/* all RTTs this round above min_rtt? */
+		cruise_queue_seen:1,	/* queueing delay seen in this CRUISE? */
+		round_queue_clear:1,	/* no queue all this round in CRUISE? */
+		queue_clear_rounds:2,	/* rounds in a row without queue */
+		round_queue_high:1,	/* all RTTs this round show a queue? */
+		unused2:2,
 		idle_restart:1,	     /* restarting after idle? */
 		probe_rtt_round_done:1,  /* a BBR_PROBE_RTT round at 4 pkts? */
 		cycle_idx:3,	/* current index in pacing_gain cycle array */
@@ -180,7 +187,9 @@ struct bbr {
 			probe_rtt_mode_ms:9,	/* max allowed value: 511 */
 			full_bw_cnt:3,		/* max allowed value: 7 */
 			cwnd_tso_budget:1,	/* allowed values: {0, 1} */
-			unused3:6,
+			min_rtt_shift_rounds:3,	/* max allowed value: 7 */
+			ecn_enable:1,		/* boolean */
+			unused3:2,
 			drain_to_target:1,	/* boolean */
 			precise_ece_ack:1,	/* boolean */
 			extra_acked_in_startup:1, /* allowed values: {0, 1} */
@@ -215,7 +224,8 @@ struct bbr {
 			tso_rtt_shift:4,	/* max allowed value: 15 */
 			unused5:1;
 		u32	ecn_reprobe_gain:9,	/* max allowed value: 511 */
-			unused1:14,
+			cruise_reprobe_rounds:2, /* max allowed value: 3 */
+			unused1:12,
 			ecn_alpha_init:9;	/* max allowed value: 256 */
 	} params;
 
@@ -247,6 +257,16 @@ static u32 bbr_probe_rtt_mode_ms = 200;
  * Note that bbr_probe_rtt_win_ms must be <= bbr_min_rtt_win_sec * MSEC_PER_SEC
  */
 static u32 bbr_probe_rtt_win_ms = 5000;
+/* Route change detection: after this many rounds in a row with every RTT
+ * sample above min_rtt by bbr_min_rtt_shift_thresh and inflight below
+ * bbr_min_rtt_shift_inflight_gain * bw * RTT, adopt the new RTT floor without
+ * waiting for the min_rtt filter to expire. 0 (default) disables, since a
+ * competing loss-based flow's queue passes the same test. Writes are clamped
+ * to 7, the largest value min_rtt_shift_cnt can hold.
+ */
+static u32 bbr_min_rtt_shift_rounds;
+static const u32 bbr_min_rtt_shift_thresh = BBR_UNIT / 4;
+static const u32 bbr_min_rtt_shift_inflight_gain = BBR_UNIT * 3 / 4;
 /* Skip TSO below the following bandwidth (bits/sec): */
 static int bbr_min_tso_rate = 1200000;
 
@@ -379,13 +399,31 @@ static bool bbr_usage_based_cwnd;		/* default: disabled */
 /* For lab testing, researchers can enable BBRv2 ECN support with this flag,
  * when they know that any ECN marks that the connections experience will be
  * DCTCP/L4S-style ECN marks, rather than RFC3168 ECN marks.
- * TODO(ncardwell): Production use of the BBRv2 ECN functionality depends on
- * negotiation or configuration that is outside the scope of the BBRv2
- * alpha release.
+ * This applies to every "bbr2" socket. To enable ECN for selected connections
+ * only, select the "bbr2_ecn" congestion control for them instead (with
+ * setsockopt(TCP_CONGESTION) or a route's congctl), refer to bbr2_ecn_init().
  */
 static bool bbr_ecn_enable = false;
 
-module_param_named(min_tso_rate,      bbr_min_tso_rate,      int,    0644);
+static int bbr_set_min_rtt_shift_rounds(const char *val,
+					const struct kernel_param *kp)
+{
+	u32 rounds;
+	int ret;
+
+	ret = kstrtou32(val, 0, &rounds);
+	if (ret)
+		return ret;
+	*(u32 *)kp->arg = min_t(u32, rounds, 7);
+	return 0;
+}
+
+static const struct kernel_param_ops bbr_min_rtt_shift_rounds_ops = {
+	.set = bbr_set_min_rtt_shift_rounds,
+	.get = param_get_uint,
+};
+
+module_param_named(min_tso_rate,     bbr_min_tso_rate,      int,    0644);
 module_param_named(tso_rtt_shift,     bbr_tso_rtt_shift,     int,    0644);
 module_param_named(high_gain,         bbr_high_gain,         int,    0644);
 module_param_named(drain_gain,        bbr_drain_gain,        int,    0644);
@@ -404,6 +442,8 @@ module_param_named(debug_with_printk, bbr_debug_with_printk, bool,   0644);
 module_param_named(min_rtt_win_sec,   bbr_min_rtt_win_sec,   uint,   0644);
 module_param_named(probe_rtt_mode_ms, bbr_probe_rtt_mode_ms, uint,   0644);
 module_param_named(probe_rtt_win_ms,  bbr_probe_rtt_win_ms,  uint,   0644);
+module_param_cb(min_rtt_shift_rounds, &bbr_min_rtt_shift_rounds_ops,
+		&bbr_min_rtt_shift_rounds,				     0644);
 module_param_named(full_bw_thresh,    bbr_full_bw_thresh,    uint,   0644);
 module_param_named(full_bw_cnt,       bbr_full_bw_cnt,       uint,   0644);
 module_param_named(cwnd_tso_bduget,   bbr_cwnd_tso_budget,   uint,   0664);
@@ -746,7 +786,7 @@ static void bbr_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 			bbr_check_probe_rtt_done(sk);
 	} else if ((event == CA_EVENT_ECN_IS_CE ||
 		    event == CA_EVENT_ECN_NO_CE) &&
-		    bbr_ecn_enable &&
+		    bbr->params.ecn_enable &&
 		    bbr->params.precise_ece_ack) {
 		u32 state = bbr->ce_state;
 		dctcp_ece_ack_update(sk, event, &bbr->prior_rcv_nxt, &state);
@@ -1118,6 +1158,55 @@ static void bbr_check_probe_rtt_done(struct sock *sk)
 	bbr2_exit_probe_rtt(sk);
 }
 
+/* After a route change to a longer path every RTT sample sits above min_rtt,
+ * yet the filters keep the old floor until probe_rtt_win_ms expires (and
+ * min_rtt_us for up to min_rtt_win_sec). Meanwhile cwnd and inflight_hi are
+ * sized for the old BDP and we run cwnd-limited at a fraction of the available
+ * bw. If for min_rtt_shift_rounds full rounds every RTT sample is well above
+ * min_rtt while inflight is well below bw * RTT (so the extra delay is not a
+ * queue we built ourselves), take the latest sample as the new floor of both
+ * filters. Later lower samples pull them down through the usual update. The
+ * filter stamps are left alone, so PROBE_RTT still comes on schedule and
+ * validates the new floor: a queue kept up by another flow is not adopted
+ * for good.
+ */
+static void bbr_check_min_rtt_shift(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bdp;
+
+	if (!bbr->params.min_rtt_shift_rounds || bbr->mode == BBR_PROBE_RTT) {
+		bbr->min_rtt_shift_cnt = 0;
+		return;
+	}
+	if (bbr->round_start) {
+		if (bbr->round_rtt_shifted)
+			bbr->min_rtt_shift_cnt = min_t(u32,
+				bbr->min_rtt_shift_cnt + 1, 7);
+		else
+			bbr->min_rtt_shift_cnt = 0;
+		bbr->round_rtt_shifted = 1;
+	}
+	if (rs->rtt_us < 0)
+		return;
+
+	bdp = (u64)bbr_bw(sk) * rs->rtt_us * bbr_min_rtt_shift_inflight_gain;
+	if (rs->rtt_us <= (u64)bbr->min_rtt_us *
+			  (BBR_UNIT + bbr_min_rtt_shift_thresh) >> BBR_SCALE ||
+	    (u64)rs->prior_in_flight * BW_UNIT * BBR_UNIT > bdp) {
+		bbr->round_rtt_shifted = 0;
+		bbr->min_rtt_shift_cnt = 0;
+		return;
+	}
+	if (bbr->min_rtt_shift_cnt >= bbr->params.min_rtt_shift_rounds) {
+		bbr->probe_rtt_min_us = rs->rtt_us;
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_shift_cnt = 0;
+		bbr->debug.event = 'T';
+	}
+}
+
 /* The goal of PROBE_RTT mode is to have BBR flows cooperatively and
  * periodically drain the bottleneck queue, to converge to measure the true
  * min_rtt (unloaded propagation delay). This allows the flows to keep queues
@@ -1144,6 +1233,8 @@ static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 	bool probe_rtt_expired, min_rtt_expired;
 	u32 expire;
 
+	bbr_check_min_rtt_shift(sk, rs);
+
 	/* Track min RTT in probe_rtt_win_ms to time next PROBE_RTT state. */
 	expire = bbr->probe_rtt_min_stamp +
 		 msecs_to_jiffies(bbr->params.probe_rtt_win_ms);
@@ -1245,6 +1336,7 @@ static void bbr_init(struct sock *sk)
 	bbr->params.extra_acked_win_rtts = min(0x1FU, bbr_extra_acked_win_rtts);
 	bbr->params.drain_to_target = bbr_drain_to_target ? 1 : 0;
 	bbr->params.precise_ece_ack = bbr_precise_ece_ack ? 1 : 0;
+	bbr->params.ecn_enable = bbr_ecn_enable ? 1 : 0;
 	bbr->params.extra_acked_in_startup = bbr_extra_acked_in_startup ? 1 : 0;
 	bbr->params.probe_rtt_cwnd_gain = min(0xFFU, bbr_probe_rtt_cwnd_gain);
 	bbr->params.probe_rtt_win_ms =
@@ -1255,6 +1347,7 @@ static void bbr_init(struct sock *sk)
 		bbr->params.pacing_gain[i] = min(0x3FF, bbr_pacing_gain[i]);
 	bbr->params.usage_based_cwnd = bbr_usage_based_cwnd ? 1 : 0;
 	bbr->params.tso_rtt_shift =  min(0xFU, bbr_tso_rtt_shift);
+	bbr->params.min_rtt_shift_rounds = min(0x7U, bbr_min_rtt_shift_rounds);
 
 	bbr->debug.snd_isn = tp->snd_una;
 	bbr->debug.target_cwnd = 0;
@@ -1273,6 +1366,12 @@ static void bbr_init(struct sock *sk)
 	bbr->probe_rtt_min_stamp = tcp_jiffies32;
 	bbr->min_rtt_us = tcp_min_rtt(tp);
 	bbr->min_rtt_stamp = tcp_jiffies32;
+	bbr->min_rtt_shift_cnt = 0;
+	bbr->round_rtt_shifted = 0;
+	bbr->cruise_queue_seen = 0;
+	bbr->round_queue_clear = 0;
+	bbr->queue_clear_rounds = 0;
+	bbr->round_queue_high = 0;
 
 	bbr->has_seen_rtt = 0;
 	bbr_init_pacing_rate_from_rtt(sk);
@@ -1407,11 +1506,14 @@ static void bbr2_update_ecn_alpha(struct sock *sk)
 	    WARN_ON_ONCE(delivered < 0 || delivered_ce < 0))  /* backwards? */
 		return;
 
-	/* See if we should use ECN sender logic for this connection. */
-	if (!bbr->ecn_eligible && bbr_ecn_enable &&
-	    (bbr->min_rtt_us <= bbr->params.ecn_max_rtt_us ||
-	     !bbr->params.ecn_max_rtt_us))
-		bbr->ecn_eligible = 1;
+	/* See if we should use ECN sender logic for this connection. This is
+	 * re-evaluated as min_rtt changes, so a flow whose path moves beyond
+	 * ecn_max_rtt_us (e.g. out of the datacenter) stops reacting to ECN,
+	 * where marks may be RFC3168-style and mean a full queue.
+	 */
+	bbr->ecn_eligible = bbr->params.ecn_enable &&
+			    (bbr->min_rtt_us <= bbr->params.ecn_max_rtt_us ||
+			     !bbr->params.ecn_max_rtt_us);
 
 	ce_ratio = (u64)delivered_ce << BBR_SCALE;
 	do_div(ce_ratio, delivered);
@@ -1856,6 +1958,10 @@ static void bbr2_start_bw_probe_cruise(struct sock *sk)
 	if (bbr->inflight_lo != ~0U)
 		bbr->inflight_lo = min(bbr->inflight_lo, bbr->inflight_hi);
 
+	bbr->cruise_queue_seen = 0;
+	bbr->round_queue_clear = 0;
+	bbr->queue_clear_rounds = 0;
+	bbr->round_queue_high = 0;
 	bbr2_set_cycle_idx(sk, BBR_BW_PROBE_CRUISE);
 }
 
@@ -1979,6 +2085,68 @@ static bool bbr2_check_time_to_probe_bw(struct sock *sk)
 	return false;
 }
 
+/* RTT above min_rtt by more than 1/4 means a standing queue in CRUISE: */
+static const u32 bbr_cruise_queue_thresh = BBR_UNIT / 4;
+/* RTT within 1/8 of min_rtt means the queue is gone: */
+static const u32 bbr_cruise_clear_thresh = BBR_UNIT / 8;
+
+/* When competing traffic leaves, the freed capacity is only discovered by the
+ * next clock-driven probe, 2-3 secs later (or the Reno round count). But the
+ * departure is visible right away: the queue the other traffic kept standing
+ * drains, so RTT falls back to min_rtt while we keep delivering at our pacing
+ * rate. If CRUISE saw a standing queue earlier (a full round with every RTT
+ * sample above min_rtt by bbr_cruise_queue_thresh, a single delayed ACK or a
+ * burst of our own does not count), and for cruise_reprobe_rounds full rounds
+ * every RTT sample was close to min_rtt with non-app-limited delivery near our
+ * bw estimate, probe now. The probe is the usual REFILL and
+ * PROBE_UP, so loss/ECN still bound it; without loss/ECN in this cycle and with
+ * the queue we saw gone, it is unlikely to cause loss.
+ *
+ * Returns whether we started a probe.
+ */
+static bool bbr2_check_freed_capacity(struct sock *sk,
+				      const struct rate_sample *rs, u32 bw)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 sample_bw;
+
+	if (!bbr->params.cruise_reprobe_rounds)
+		return false;
+
+	if (bbr->round_start) {
+		if (!bbr->round_queue_clear)
+			bbr->queue_clear_rounds = 0;
+		else if (bbr->queue_clear_rounds < 3)
+			bbr->queue_clear_rounds++;
+		if (bbr->round_queue_high)
+			bbr->cruise_queue_seen = 1;
+		bbr->round_queue_clear = 1;
+		bbr->round_queue_high = 1;
+	}
+	if (rs->rtt_us >= 0) {
+		if (rs->rtt_us <= (u64)bbr->min_rtt_us *
+				  (BBR_UNIT + bbr_cruise_queue_thresh) >> BBR_SCALE)
+			bbr->round_queue_high = 0;
+		if (rs->rtt_us > (u64)bbr->min_rtt_us *
+				 (BBR_UNIT + bbr_cruise_clear_thresh) >> BBR_SCALE)
+			bbr->round_queue_clear = 0;
+	}
+	sample_bw = rs->delivered > 0 && rs->interval_us > 0 ?
+		div_u64((u64)rs->delivered * BW_UNIT, rs->interval_us) : 0;
+	if (rs->is_app_limited || (sample_bw << 3) < (u64)bw * 7)
+		bbr->round_queue_clear = 0;
+
+	if (!bbr->cruise_queue_seen ||
+	    bbr->queue_clear_rounds < bbr->params.cruise_reprobe_rounds ||
+	    bbr->loss_in_cycle || bbr->ecn_in_cycle ||
+	    inet_csk(sk)->icsk_ca_state != TCP_CA_Open)
+		return false;
+
+	bbr->debug.event = 'F';  /* capacity *F*reed */
+	bbr2_start_bw_probe_refill(sk, 0);
+	return true;
+}
+
 /* Is it time to transition from PROBE_DOWN to PROBE_CRUISE? */
 static bool bbr2_check_time_to_cruise(struct sock *sk, u32 inflight, u32 bw)
 {
@@ -2025,7 +2193,8 @@ static void bbr2_update_cycle_phase(struct sock *sk,
 	 * by slowing down.
 	 */
 	case BBR_BW_PROBE_CRUISE:
-		if (bbr2_check_time_to_probe_bw(sk))
+		if (bbr2_check_time_to_probe_bw(sk) ||
+		    bbr2_check_freed_capacity(sk, rs, bbr_bw(sk)))
 			return;		/* already decided state transition */
 		break;
 
@@ -2382,6 +2551,12 @@ static int bbr_fast_ack_mode = 1;	/* default: rwnd check off */
 /* How much to additively increase inflight_hi when entering REFILL? */
 static u32 bbr_refill_add_inc;		/* default: disabled */
 
+/* Probe early in CRUISE once the queueing delay seen earlier in the phase has
+ * been gone for this many rounds, refer to bbr2_check_freed_capacity().
+ * 0 (default) disables. Max allowed value is 3.
+ */
+static u32 bbr_cruise_reprobe_rounds;
+
 module_param_named(beta,                 bbr_beta,                 uint, 0644);
 module_param_named(ecn_alpha_gain,       bbr_ecn_alpha_gain,       uint, 0644);
 module_param_named(ecn_alpha_init,       bbr_ecn_alpha_init,       uint, 0644);
@@ -2403,6 +2578,7 @@ module_param_named(undo,                 bbr_undo,                 bool, 0664);
 module_param_named(fast_path,		 bbr_fast_path,		   bool, 0664);
 module_param_named(fast_ack_mode,	 bbr_fast_ack_mode,	   uint, 0664);
 module_param_named(refill_add_inc,       bbr_refill_add_inc,       uint, 0664);
+module_param_named(cruise_reprobe_rounds, bbr_cruise_reprobe_rounds, uint, 0664);
 
 static void bbr2_init(struct sock *sk)
 {
@@ -2439,6 +2615,8 @@ static void bbr2_init(struct sock *sk)
 	bbr->params.undo = bbr_undo;
 	bbr->params.fast_path = bbr_fast_path ? 1 : 0;
 	bbr->params.refill_add_inc = min_t(u32, 0x3U, bbr_refill_add_inc);
+	bbr->params.cruise_reprobe_rounds =
+		min_t(u32, 0x3U, bbr_cruise_reprobe_rounds);
 
 	/* BBR v2 state: */
 	bbr->initialized = 1;
@@ -2472,7 +2650,25 @@ static void bbr2_init(struct sock *sk)
 
 	tp->fast_ack_mode = min_t(u32, 0x2U, bbr_fast_ack_mode);
 
-	if ((tp->ecn_flags & TCP_ECN_OK) && bbr_ecn_enable)
+	if ((tp->ecn_flags & TCP_ECN_OK) && bbr->params.ecn_enable)
+		tp->ecn_flags |= TCP_ECN_ECT_PERMANENT;
+}
+
+/* "bbr2_ecn" is bbr2 with ECN enabled for this socket only, for connections
+ * known to stay within a fabric with DCTCP/L4S-style marking (e.g. selected
+ * with a route's congctl for datacenter prefixes). TCP_CONG_NEEDS_ECN makes
+ * the stack negotiate ECN whatever net.ipv4.tcp_ecn says. A receiver using
+ * bbr2_ecn acks each CE state change right away (precise_ece_ack), so the
+ * sender counts CE marks per packet in delivered_ce rather than per round.
+ */
+static void bbr2_ecn_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr2_init(sk);
+	bbr->params.ecn_enable = 1;
+	if (tp->ecn_flags & TCP_ECN_OK)
 		tp->ecn_flags |= TCP_ECN_ECT_PERMANENT;
 }
 
@@ -2647,14 +2843,192 @@ static struct tcp_congestion_ops tcp_bbr2_cong_ops __read_mostly = {
 	.set_state	= bbr2_set_state,
 };
 
+static struct tcp_congestion_ops tcp_bbr2_ecn_cong_ops __read_mostly = {
+	.flags		= TCP_CONG_NON_RESTRICTED | TCP_CONG_WANTS_CE_EVENTS |
+			  TCP_CONG_NEEDS_ECN,
+	.name		= "bbr2_ecn",
+	.owner		= THIS_MODULE,
+	.init		= bbr2_ecn_init,
+	.cong_control	= bbr2_main,
+	.sndbuf_expand	= bbr_sndbuf_expand,
+	.skb_marked_lost = bbr2_skb_marked_lost,
+	.undo_cwnd	= bbr2_undo_cwnd,
+	.cwnd_event	= bbr_cwnd_event,
+	.ssthresh	= bbr2_ssthresh,
+	.tso_segs	= bbr_tso_segs,
+	.get_info	= bbr2_get_info,
+	.set_state	= bbr2_set_state,
+};
+
+/* __________________________________________________________________________
+ *
+ * Model checkpoint/restore, for connections that are migrated with TCP_REPAIR
+ * (e.g. CRIU live migration) or handed off between processes. Without this a
+ * restored socket gets a fresh bbr2_init() and restarts from STARTUP. The
+ * snapshot layout and the locking rules are in bbr2_model.h.
+ * __________________________________________________________________________
+ */
+
+static bool bbr2_is_bbr2_sock(const struct sock *sk)
+{
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return (inet_csk(sk)->icsk_ca_ops == &tcp_bbr2_cong_ops ||
+		inet_csk(sk)->icsk_ca_ops == &tcp_bbr2_ecn_cong_ops) &&
+	       bbr->initialized;
+}
+
+/* Capture the path model of a bbr2 socket into a snapshot. The caller holds
+ * the socket lock.
+ */
+int bbr2_export_model(struct sock *sk, struct bbr2_model_snapshot *snap)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!bbr2_is_bbr2_sock(sk))
+		return -EINVAL;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->version = BBR2_MODEL_SNAPSHOT_VERSION;
+	snap->min_rtt_us = bbr->min_rtt_us;
+	snap->min_rtt_age_ms =
+		jiffies_to_msecs(tcp_jiffies32 - bbr->min_rtt_stamp);
+	snap->probe_rtt_min_us = bbr->probe_rtt_min_us;
+	snap->probe_rtt_min_age_ms =
+		jiffies_to_msecs(tcp_jiffies32 - bbr->probe_rtt_min_stamp);
+	snap->bw_hi[0] = bbr->bw_hi[0];
+	snap->bw_hi[1] = bbr->bw_hi[1];
+	snap->bw_lo = bbr->bw_lo;
+	snap->inflight_hi = bbr->inflight_hi;
+	snap->inflight_lo = bbr->inflight_lo;
+	snap->full_bw = bbr->full_bw;
+	snap->prior_cwnd = max(bbr->prior_cwnd, tp->snd_cwnd);
+	snap->probe_wait_us = bbr->probe_wait_us;
+	snap->cycle_age_us = clamp_t(s64, tcp_stamp_us_delta(tp->tcp_mstamp,
+							      bbr->cycle_mstamp),
+				     0, U32_MAX);
+	snap->mode = bbr->mode;
+	snap->cycle_idx = bbr->cycle_idx;
+	snap->full_bw_reached = bbr->full_bw_reached;
+	snap->ecn_eligible = bbr->ecn_eligible;
+	snap->prev_probe_too_high = bbr->prev_probe_too_high;
+	snap->rounds_since_probe = bbr->rounds_since_probe;
+	snap->ecn_alpha = bbr->ecn_alpha;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bbr2_export_model);
+
+/* Convert the age of a filter sample into a jiffies stamp, treating samples
+ * older than the filter window as already expired.
+ */
+static u32 bbr2_stamp_from_age_ms(u32 age_ms, u32 win_ms)
+{
+	return tcp_jiffies32 - msecs_to_jiffies(min(age_ms, win_ms + 1));
+}
+
+/* Seed a freshly initialized bbr2 socket with a previously exported model, so
+ * that the flow continues at its previous operating point. The restored flow
+ * does not know what its predecessor had queued in the network, so a flow
+ * that was probing resumes in PROBE_BW cruise with a freshly picked probe wait,
+ * as when exiting PROBE_RTT. Round-trip counting restarts from the new
+ * socket's delivered count. The caller holds the socket lock.
+ */
+int bbr2_import_model(struct sock *sk, const struct bbr2_model_snapshot *snap)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw, cwnd;
+
+	if (!bbr2_is_bbr2_sock(sk))
+		return -EINVAL;
+	if (snap->version != BBR2_MODEL_SNAPSHOT_VERSION ||
+	    snap->mode > BBR_PROBE_RTT ||
+	    snap->cycle_idx > BBR_BW_PROBE_REFILL ||
+	    !snap->min_rtt_us || snap->ecn_alpha > BBR_UNIT)
+		return -EINVAL;
+
+	bbr->min_rtt_us = snap->min_rtt_us;
+	bbr->min_rtt_stamp =
+		bbr2_stamp_from_age_ms(snap->min_rtt_age_ms,
+				       bbr->params.min_rtt_win_sec *
+				       MSEC_PER_SEC);
+	bbr->probe_rtt_min_us = snap->probe_rtt_min_us;
+	bbr->probe_rtt_min_stamp =
+		bbr2_stamp_from_age_ms(snap->probe_rtt_min_age_ms,
+				       bbr->params.probe_rtt_win_ms);
+	bbr->has_seen_rtt = 1;
+
+	bbr->bw_hi[0] = snap->bw_hi[0];
+	bbr->bw_hi[1] = snap->bw_hi[1];
+	bbr->bw_lo = snap->bw_lo;
+	bbr->inflight_hi = snap->inflight_hi;
+	bbr->inflight_lo = snap->inflight_lo;
+	bbr->full_bw = snap->full_bw;
+	bbr->full_bw_reached = snap->full_bw_reached;
+	bbr->full_bw_cnt = snap->full_bw_reached ? bbr->params.full_bw_cnt : 0;
+	bbr->prior_cwnd = snap->prior_cwnd;
+	bbr->ecn_eligible = snap->ecn_eligible;
+	bbr->ecn_alpha = snap->ecn_alpha;
+	bbr->prev_probe_too_high = snap->prev_probe_too_high;
+	bbr->alpha_last_delivered = tp->delivered;
+	bbr->alpha_last_delivered_ce = tp->delivered_ce;
+
+	/* Restart packet-timed round trips on the new socket. */
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr->loss_round_delivered = tp->delivered + 1;
+	bbr2_reset_congestion_signals(sk);
+
+	if (!bbr_full_bw_reached(sk)) {
+		bbr->mode = BBR_STARTUP;
+	} else if (snap->mode == BBR_PROBE_BW &&
+		   snap->cycle_idx == BBR_BW_PROBE_CRUISE) {
+		/* Keep the remaining wait until the next bw probe. */
+		bbr->mode = BBR_PROBE_BW;
+		bbr->rounds_since_probe = snap->rounds_since_probe;
+		bbr->probe_wait_us = snap->probe_wait_us;
+		bbr->cycle_mstamp = tp->tcp_mstamp - snap->cycle_age_us;
+		bbr->ack_phase = BBR_ACKS_INIT;
+		bbr2_start_bw_probe_cruise(sk);
+	} else {
+		bbr->mode = BBR_PROBE_BW;
+		bbr2_start_bw_probe_down(sk);
+		bbr2_start_bw_probe_cruise(sk);
+	}
+	bbr->try_fast_path = 0;
+	bbr_update_gains(sk);
+
+	/* Pick up sending where the predecessor left off. */
+	bw = bbr_bw(sk);
+	if (bw) {
+		sk->sk_pacing_rate = bbr_bw_to_pacing_rate(sk, bw,
+							   bbr->pacing_gain);
+		cwnd = bbr_inflight(sk, bw, bbr->cwnd_gain);
+		cwnd = max(cwnd, bbr->prior_cwnd);
+		tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);
+		bbr2_bound_cwnd_for_inflight_model(sk);
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bbr2_import_model);
+
 static int __init bbr_register(void)
 {
+	int ret;
+
 	BUILD_BUG_ON(sizeof(struct bbr) > ICSK_CA_PRIV_SIZE);
-	return tcp_register_congestion_control(&tcp_bbr2_cong_ops);
+	ret = tcp_register_congestion_control(&tcp_bbr2_cong_ops);
+	if (ret)
+		return ret;
+	ret = tcp_register_congestion_control(&tcp_bbr2_ecn_cong_ops);
+	if (ret)
+		tcp_unregister_congestion_control(&tcp_bbr2_cong_ops);
+	return ret;
 }
 
 static void __exit bbr_unregister(void)
 {
+	tcp_unregister_congestion_control(&tcp_bbr2_ecn_cong_ops);
 	tcp_unregister_congestion_control(&tcp_bbr2_cong_ops);
 }
 
@@ -2670,5 +3044,6 @@ MODULE_AUTHOR("Yousuk Seung <ysseung@google.com>");
 MODULE_AUTHOR("Kevin Yang <yyd@google.com>");
 MODULE_AUTHOR("Arjun Roy <arjunroy@google.com>");
 
+MODULE_ALIAS("tcp_bbr2_ecn");
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("TCP BBR (Bottleneck Bandwidth and RTT)");
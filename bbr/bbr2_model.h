@@ -0,0 +1,57 @@
+/* BBR v2 model checkpoint/restore
+ *
+ * For connections that are migrated with TCP_REPAIR (e.g. CRIU live
+ * migration) or handed off between processes: bbr2_export_model() captures
+ * the path model of a bbr2 socket, bbr2_import_model() seeds the bbr2 socket
+ * that replaces it, so the flow continues at its previous operating point
+ * instead of restarting from STARTUP. bbr/bbr2_model_test.c shows the usage.
+ *
+ * Locking: the caller must own the socket, i.e. hold lock_sock() (or
+ * bh_lock_sock() with !sock_owned_by_user() in softirq context), so that
+ * neither the ACK path nor a TCP_CONGESTION change touches struct bbr while
+ * it is read or written. Both return -EINVAL if the socket does not run an
+ * initialized bbr2 or bbr2_ecn, e.g. before the connection is established.
+ * Import the snapshot before the restored socket sends new data.
+ */
+#ifndef _BBR2_MODEL_H
+#define _BBR2_MODEL_H
+
+#include <linux/types.h>
+
+struct sock;
+
+#define BBR2_MODEL_SNAPSHOT_VERSION	1
+
+/* Path model of a bbr2 flow. Timestamps are stored as ages relative to the
+ * time of export, since jiffies and tcp_mstamp are not comparable across
+ * hosts. Bandwidths are in pkts/uS << BW_SCALE, inflight in packets.
+ */
+struct bbr2_model_snapshot {
+	u32	version;		/* BBR2_MODEL_SNAPSHOT_VERSION */
+	u32	min_rtt_us;		/* min RTT in min_rtt_win_sec window */
+	u32	min_rtt_age_ms;		/* age of min_rtt_us */
+	u32	probe_rtt_min_us;	/* min RTT in probe_rtt_win_ms window */
+	u32	probe_rtt_min_age_ms;	/* age of probe_rtt_min_us */
+	u32	bw_hi[2];		/* max bw filter windows */
+	u32	bw_lo;			/* lower bound on sending bandwidth */
+	u32	inflight_hi;		/* upper bound of inflight data range */
+	u32	inflight_lo;		/* lower bound of inflight data range */
+	u32	full_bw;		/* recent bw, to estimate if pipe is full */
+	u32	prior_cwnd;		/* last known good cwnd */
+	u32	probe_wait_us;		/* PROBE_DOWN until next clock probe */
+	u32	cycle_age_us;		/* time since this cycle phase start */
+	u8	mode;			/* bbr_mode */
+	u8	cycle_idx;		/* bbr_pacing_gain_phase */
+	u8	full_bw_reached:1,	/* reached full bw in Startup? */
+		ecn_eligible:1,		/* sender can use ECN? */
+		prev_probe_too_high:1,	/* did last PROBE_UP go too high? */
+		unused:5;
+	u8	rounds_since_probe;	/* packet-timed rounds since probed bw */
+	u16	ecn_alpha;		/* EWMA delivered_ce/delivered; 0..256 */
+	u16	unused2;
+};
+
+int bbr2_export_model(struct sock *sk, struct bbr2_model_snapshot *snap);
+int bbr2_import_model(struct sock *sk, const struct bbr2_model_snapshot *snap);
+
+#endif /* _BBR2_MODEL_H */
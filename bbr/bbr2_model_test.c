@@ -0,0 +1,199 @@
+/* Self test of the bbr2 model checkpoint/restore, refer to bbr2_model.h
+ *
+ * On load it opens two bbr2 connections over loopback, moves some data over
+ * the first one, exports its model, imports it into the second one and checks
+ * that the second one now exports the same path model, as a TCP_REPAIR restore
+ * would do it. Built next to bbr2.c (obj-m += bbr2.o bbr2_model_test.o), the
+ * result is in the kernel log:
+ *
+ *   insmod bbr2.ko && insmod bbr2_model_test.ko && dmesg | tail
+ *
+ * Loading fails if a check fails. Needs linux 5.9 or later (sockptr_t).
+ */
+#include <linux/module.h>
+#include <linux/net.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/uio.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+#include "bbr2_model.h"
+
+static ushort port = 50001;
+module_param(port, ushort, 0444);
+
+/* Data moved over the first connection before its model is exported: */
+static const int bbr2_test_rounds = 32;
+static const int bbr2_test_chunk = 64 * 1024;
+
+static int bbr2_test_connect(struct socket *listener,
+			     struct sockaddr_in *addr,
+			     struct socket **client, struct socket **server)
+{
+	static const char name[] = "bbr2";
+	int ret;
+
+	ret = sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_TCP,
+			       client);
+	if (ret)
+		return ret;
+	ret = (*client)->ops->setsockopt(*client, SOL_TCP, TCP_CONGESTION,
+					 KERNEL_SOCKPTR(name), strlen(name));
+	if (!ret)
+		ret = kernel_connect(*client, (struct sockaddr *)addr,
+				     sizeof(*addr), 0);
+	if (!ret)
+		ret = kernel_accept(listener, server, 0);
+	if (ret) {
+		sock_release(*client);
+		*client = NULL;
+	}
+	return ret;
+}
+
+/* Send bbr2_test_rounds chunks from client to server, reading each one before
+ * sending the next so neither side blocks on a full buffer.
+ */
+static int bbr2_test_transfer(struct socket *client, struct socket *server,
+			      char *buf)
+{
+	struct msghdr msg = {};
+	struct kvec iov;
+	int i, ret;
+
+	for (i = 0; i < bbr2_test_rounds; i++) {
+		iov.iov_base = buf;
+		iov.iov_len = bbr2_test_chunk;
+		ret = kernel_sendmsg(client, &msg, &iov, 1, bbr2_test_chunk);
+		if (ret != bbr2_test_chunk)
+			return ret < 0 ? ret : -EIO;
+		ret = kernel_recvmsg(server, &msg, &iov, 1, bbr2_test_chunk,
+				     MSG_WAITALL);
+		if (ret != bbr2_test_chunk)
+			return ret < 0 ? ret : -EIO;
+	}
+	return 0;
+}
+
+/* Export the model of sk; the ACK path must not run meanwhile. */
+static int bbr2_test_export(struct sock *sk, struct bbr2_model_snapshot *snap)
+{
+	int ret;
+
+	lock_sock(sk);
+	ret = bbr2_export_model(sk, snap);
+	release_sock(sk);
+	return ret;
+}
+
+static int bbr2_test_import(struct sock *sk,
+			    const struct bbr2_model_snapshot *snap,
+			    struct bbr2_model_snapshot *check)
+{
+	int ret;
+
+	lock_sock(sk);
+	ret = bbr2_import_model(sk, snap);
+	if (!ret)
+		ret = bbr2_export_model(sk, check);
+	release_sock(sk);
+	return ret;
+}
+
+#define BBR2_TEST_CHECK(cond)						\
+	do {								\
+		if (!(cond)) {						\
+			pr_err("bbr2_model_test: failed: %s\n", #cond);	\
+			ret = -EINVAL;					\
+			goto out;					\
+		}							\
+	} while (0)
+
+static int __init bbr2_model_test_init(void)
+{
+	struct bbr2_model_snapshot snap, check, bad;
+	struct socket *listener = NULL, *client[2] = {}, *server[2] = {};
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = htons(port),
+	};
+	char *buf;
+	int i, ret;
+
+	buf = kzalloc(bbr2_test_chunk, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	ret = sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_TCP,
+			       &listener);
+	if (ret)
+		goto out;
+	sock_set_reuseaddr(listener->sk);
+	ret = kernel_bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+	if (!ret)
+		ret = kernel_listen(listener, 2);
+	for (i = 0; i < 2 && !ret; i++)
+		ret = bbr2_test_connect(listener, &addr, &client[i], &server[i]);
+	if (ret) {
+		pr_err("bbr2_model_test: no bbr2 connection on port %u: %d\n",
+		       port, ret);
+		goto out;
+	}
+
+	/* A socket without an initialized bbr2 has no model to export. */
+	BBR2_TEST_CHECK(bbr2_test_export(listener->sk, &snap) == -EINVAL);
+
+	ret = bbr2_test_transfer(client[0], server[0], buf);
+	if (ret) {
+		pr_err("bbr2_model_test: transfer failed: %d\n", ret);
+		goto out;
+	}
+	ret = bbr2_test_export(client[0]->sk, &snap);
+	BBR2_TEST_CHECK(!ret);
+	BBR2_TEST_CHECK(snap.version == BBR2_MODEL_SNAPSHOT_VERSION);
+
+	/* A snapshot of another layout is refused. */
+	bad = snap;
+	bad.version++;
+	lock_sock(client[1]->sk);
+	ret = bbr2_import_model(client[1]->sk, &bad);
+	release_sock(client[1]->sk);
+	BBR2_TEST_CHECK(ret == -EINVAL);
+
+	ret = bbr2_test_import(client[1]->sk, &snap, &check);
+	BBR2_TEST_CHECK(!ret);
+	BBR2_TEST_CHECK(check.min_rtt_us == snap.min_rtt_us);
+	BBR2_TEST_CHECK(check.probe_rtt_min_us == snap.probe_rtt_min_us);
+	BBR2_TEST_CHECK(check.bw_hi[0] == snap.bw_hi[0]);
+	BBR2_TEST_CHECK(check.bw_hi[1] == snap.bw_hi[1]);
+	BBR2_TEST_CHECK(check.inflight_hi == snap.inflight_hi);
+	BBR2_TEST_CHECK(check.full_bw == snap.full_bw);
+	BBR2_TEST_CHECK(check.full_bw_reached == snap.full_bw_reached);
+	BBR2_TEST_CHECK(check.ecn_alpha == snap.ecn_alpha);
+	BBR2_TEST_CHECK(check.prior_cwnd >= snap.prior_cwnd);
+	pr_info("bbr2_model_test: passed, min_rtt %u us bw_hi %u/%u inflight_hi %u mode %u\n",
+		snap.min_rtt_us, snap.bw_hi[0], snap.bw_hi[1], snap.inflight_hi,
+		snap.mode);
+out:
+	for (i = 0; i < 2; i++) {
+		if (client[i])
+			sock_release(client[i]);
+		if (server[i])
+			sock_release(server[i]);
+	}
+	if (listener)
+		sock_release(listener);
+	kfree(buf);
+	return ret;
+}
+
+static void __exit bbr2_model_test_exit(void)
+{
+}
+
+module_init(bbr2_model_test_init);
+module_exit(bbr2_model_test_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Self test of the TCP BBR v2 model checkpoint/restore");
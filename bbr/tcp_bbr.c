@@ -100,7 +100,9 @@ struct bbr {
 		tso_segs_goal:7,     /* segments we want in each skb we send */
 		idle_restart:1,	     /* restarting after idle? */
 		probe_rtt_round_done:1,  /* a BBR_PROBE_RTT round at 4 pkts? */
-		unused:5,
+		min_rtt_shift_cnt:3, /* rounds with RTT floor above min_rtt */
+		round_rtt_shifted:1, /* all RTTs this round above min_rtt? */
+		unused:1,
 		lt_is_sampling:1,    /* taking long-term ("LT") samples now? */
 		lt_rtt_cnt:7,	     /* round trips in long-term interval */
 		lt_use_bw:1;	     /* use lt_bw as our bw estimate? */
@@ -175,6 +177,45 @@ static const u32 bbr_lt_bw_diff = 4000 / 8;
 /* If we estimate we're policed, use lt_bw for this many round trips: */
 static const u32 bbr_lt_bw_max_rtts = 48;
 
+/* Route change detection, refer to bbr_check_min_rtt_shift(). Off by default:
+ * next to a loss-based flow that keeps the bottleneck queue full every sample
+ * also looks like a longer path, so this is only meant for experiments.
+ */
+/* An RTT sample is above the old floor if it exceeds min_rtt by 1/4: */
+static const u32 bbr_min_rtt_shift_thresh = BBR_UNIT / 4;
+/* and it can't be our own queue if inflight < 3/4 of bw * that RTT: */
+static const u32 bbr_min_rtt_shift_inflight_gain = BBR_UNIT * 3 / 4;
+/* After this many such rounds in a row adopt the new floor, 0 disables.
+ * Writes are clamped to 7, the largest value min_rtt_shift_cnt can hold.
+ */
+static u32 bbr_min_rtt_shift_rounds;
+
+static int bbr_set_min_rtt_shift_rounds(const char *val,
+					const struct kernel_param *kp)
+{
+	u32 rounds;
+	int ret;
+
+	ret = kstrtou32(val, 0, &rounds);
+	if (ret)
+		return ret;
+	*(u32 *)kp->arg = min_t(u32, rounds, 7);
+	return 0;
+}
+
+static const struct kernel_param_ops bbr_min_rtt_shift_rounds_ops = {
+	.set = bbr_set_min_rtt_shift_rounds,
+	.get = param_get_uint,
+};
+module_param_cb(min_rtt_shift_rounds, &bbr_min_rtt_shift_rounds_ops,
+		&bbr_min_rtt_shift_rounds, 0644);
+
+/* Skip the model update on quiet ACKs, only their bw samples go into the
+ * filter, refer to bbr_quiet_ack():
+ */
+static bool bbr_round_aggregate;
+module_param_named(round_aggregate, bbr_round_aggregate, bool, 0644);
+
 /* Do we estimate that STARTUP filled the pipe? */
 static bool bbr_full_bw_reached(const struct sock *sk)
 {
@@ -735,6 +776,52 @@ static void bbr_check_drain(struct sock *sk, const struct rate_sample *rs)
 		bbr_reset_probe_bw_mode(sk);  /* we estimate queue is drained */
 }
 
+/* After a route change to a longer path every RTT sample sits above min_rtt,
+ * yet the min_rtt filter keeps the old floor for up to bbr_min_rtt_win_sec.
+ * Meanwhile cwnd is sized for the old BDP and we run cwnd-limited at a
+ * fraction of the available bw. If for bbr_min_rtt_shift_rounds full rounds
+ * every RTT sample is well above min_rtt while inflight is well below
+ * bw * RTT (so the extra delay is not a queue we built ourselves), take the
+ * latest sample as the new min_rtt. Later lower samples in the round pull it
+ * down to the new floor through the usual filter update. min_rtt_stamp is
+ * left alone, so PROBE_RTT still comes on schedule and validates the new
+ * floor: a queue kept up by another flow is not adopted for good.
+ */
+static void bbr_check_min_rtt_shift(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bdp;
+
+	if (!bbr_min_rtt_shift_rounds || bbr->mode == BBR_PROBE_RTT) {
+		bbr->min_rtt_shift_cnt = 0;
+		return;
+	}
+	if (bbr->round_start) {
+		if (bbr->round_rtt_shifted)
+			bbr->min_rtt_shift_cnt = min_t(u32,
+				bbr->min_rtt_shift_cnt + 1, 7);
+		else
+			bbr->min_rtt_shift_cnt = 0;
+		bbr->round_rtt_shifted = 1;
+	}
+	if (rs->rtt_us < 0)
+		return;
+
+	bdp = (u64)bbr_bw(sk) * rs->rtt_us * bbr_min_rtt_shift_inflight_gain;
+	if (rs->rtt_us <= (u64)bbr->min_rtt_us *
+			  (BBR_UNIT + bbr_min_rtt_shift_thresh) >> BBR_SCALE ||
+	    (u64)rs->prior_in_flight * BW_UNIT * BBR_UNIT > bdp) {
+		bbr->round_rtt_shifted = 0;
+		bbr->min_rtt_shift_cnt = 0;
+		return;
+	}
+	if (bbr->min_rtt_shift_cnt >= bbr_min_rtt_shift_rounds) {
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_shift_cnt = 0;
+	}
+}
+
 /* The goal of PROBE_RTT mode is to have BBR flows cooperatively and
  * periodically drain the bottleneck queue, to converge to measure the true
  * min_rtt (unloaded propagation delay). This allows the flows to keep queues
@@ -760,6 +847,8 @@ static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 	struct bbr *bbr = inet_csk_ca(sk);
 	bool filter_expired;
 
+	bbr_check_min_rtt_shift(sk, rs);
+
 	/* Track min RTT seen in the min_rtt_win_sec filter window: */
 	filter_expired = after(tcp_jiffies32,
 			       bbr->min_rtt_stamp + bbr_min_rtt_win_sec * HZ);
@@ -803,8 +892,54 @@ static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 	bbr->idle_restart = 0;
 }
 
+/* Most ACKs in PROBE_BW change nothing in the model: no round starts, no loss,
+ * the bw sample is below the max filter, the RTT sample is above min_rtt, and
+ * the gain cycle phase can't end yet. On such a quiet ACK the only effect of
+ * bbr_update_model() is the bw filter update, which can't change the max within
+ * the round. So feed the sample straight to the filter with
+ * minmax_running_max(), a few compares and no extra state in struct bbr
+ * (which fills ICSK_CA_PRIV_SIZE on 4.14), and skip the rest. Every decision
+ * is taken on the same ACK as without it.
+ *
+ * Returns whether the ACK was quiet and the model update can be skipped.
+ */
+static bool bbr_quiet_ack(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+
+	if (bbr->mode != BBR_PROBE_BW || bbr->pacing_gain != BBR_UNIT ||
+	    bbr->lt_is_sampling || bbr->lt_use_bw || rs->losses ||
+	    rs->delivered < 0 || rs->interval_us <= 0 ||
+	    !before(rs->prior_delivered, bbr->next_rtt_delivered))
+		return false;
+	/* Cycle phase ends, or min_rtt changes or expires? */
+	if (tcp_stamp_us_delta(tp->delivered_mstamp, bbr->cycle_mstamp) >
+	    bbr->min_rtt_us ||
+	    (rs->rtt_us >= 0 && rs->rtt_us <= bbr->min_rtt_us) ||
+	    after(tcp_jiffies32,
+		  bbr->min_rtt_stamp + bbr_min_rtt_win_sec * HZ))
+		return false;
+
+	bw = (u64)rs->delivered * BW_UNIT;
+	do_div(bw, rs->interval_us);
+	if (bw >= bbr_max_bw(sk))
+		return false;
+
+	bbr->round_start = 0;
+	if (!rs->is_app_limited)
+		minmax_running_max(&bbr->bw, bbr_bw_rtts, bbr->rtt_cnt, bw);
+	bbr_check_min_rtt_shift(sk, rs);
+	bbr->idle_restart = 0;
+	return true;
+}
+
 static void bbr_update_model(struct sock *sk, const struct rate_sample *rs)
 {
+	if (bbr_round_aggregate && bbr_quiet_ack(sk, rs))
+		return;
+
 	bbr_update_bw(sk, rs);
 	bbr_update_cycle_phase(sk, rs);
 	bbr_check_full_bw_reached(sk, rs);
@@ -841,6 +976,8 @@ static void bbr_init(struct sock *sk)
 	bbr->probe_rtt_round_done = 0;
 	bbr->min_rtt_us = tcp_min_rtt(tp);
 	bbr->min_rtt_stamp = tcp_jiffies32;
+	bbr->min_rtt_shift_cnt = 0;
+	bbr->round_rtt_shifted = 0;
 
 	minmax_reset(&bbr->bw, bbr->rtt_cnt, 0);  /* init max bw to 0 */
 
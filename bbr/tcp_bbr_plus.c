@@ -101,7 +101,8 @@ struct bbr {
         tso_segs_goal:7,     /* segments we want in each skb we send */
         idle_restart:1,      /* restarting after idle? */
         probe_rtt_round_done:1,  /* a BBR_PROBE_RTT round at 4 pkts? */
-        unused:8,
+        probe_rounds:6,      /* min_rtts between bw probes this cycle */
+        unused:2,
         lt_is_sampling:1,    /* taking long-term ("LT") samples now? */
         lt_rtt_cnt:7,        /* round trips in long-term interval */
         lt_use_bw:1;         /* use lt_bw as our bw estimate? */
@@ -205,6 +206,22 @@ static const u32 bbr_extra_acked_max_us = 100 * 1000;
 /* Each cycle, try to hold sub-unity gain until inflight <= BDP. */
 static const bool bbr_drain_to_target = true;   /* default: enabled */
 
+/* Scale the time between bw probes with the estimated BDP, in the spirit of
+ * bbr2_is_reno_coexistence_probe_time(): an idealized Reno flow needs BDP
+ * round trips between loss epochs, so probe every BDP rounds (at least
+ * cycle_len, at most bbr_probe_max_rounds), within a wall clock window.
+ */
+static const bool bbr_bdp_scaled_cycling = true;    /* default: enabled */
+/* Max number of min_rtts to wait before probing for bandwidth. The bw filter
+ * window is stretched to cover it, so we never forget a good bw estimate.
+ */
+static const u32 bbr_probe_max_rounds = 63;
+/* Don't probe more often than this on low-BDP paths (e.g. LAN): */
+static const u32 bbr_probe_min_us = 10 * USEC_PER_MSEC;    /* 10 ms */
+/* Don't wait longer than 2-3 secs between probes on huge-BDP paths: */
+static const u32 bbr_probe_base_us = 2 * USEC_PER_SEC;     /* 2 secs */
+static const u32 bbr_probe_rand_us = 1 * USEC_PER_SEC;     /* 1 secs */
+
 extern bool tcp_snd_wnd_test(const struct tcp_sock *tp,
                  const struct sk_buff *skb,
                  unsigned int cur_mss);
@@ -228,6 +245,44 @@ static void bbr_set_cycle_idx(struct sock *sk, int cycle_idx)
 u32 bbr_max_bw(const struct sock *sk);
 u32 bbr_inflight(struct sock *sk, u32 bw, int gain);
 u32 bbr_max_bw(const struct sock *sk);
+static u32 bbr_bdp(struct sock *sk, u32 bw, int gain);
+
+/* Pick how many min_rtts to cruise before the next bw probe. Without
+ * bbr_bdp_scaled_cycling this is the randomized cycle_len of [2 to 8].
+ */
+static void bbr_pick_probe_rounds(struct sock *sk)
+{
+    struct bbr *bbr = inet_csk_ca(sk);
+    u32 rounds, wait_us;
+
+    rounds = bbr->cycle_len;
+    if (!bbr_bdp_scaled_cycling || !bbr->min_rtt_us ||
+        bbr->min_rtt_us == ~0U) {
+        bbr->probe_rounds = rounds;
+        return;
+    }
+
+    /* Reno-coexistence time scale: BDP round trips. */
+    rounds = max(rounds, bbr_bdp(sk, bbr_max_bw(sk), BBR_UNIT));
+    rounds = min(rounds, bbr_probe_max_rounds);
+
+    /* Bound by wall clock: not too often, and not too rarely. */
+    wait_us = bbr_probe_base_us + prandom_u32_max(bbr_probe_rand_us);
+    if ((u64)rounds * bbr->min_rtt_us > wait_us)
+        rounds = max_t(u32, bbr->cycle_len, wait_us / bbr->min_rtt_us);
+    if ((u64)rounds * bbr->min_rtt_us < bbr_probe_min_us)
+        rounds = min(bbr_probe_max_rounds,
+                     DIV_ROUND_UP(bbr_probe_min_us, bbr->min_rtt_us));
+    bbr->probe_rounds = rounds;
+}
+
+/* Window length of bw filter (in rounds), covering the probing cycle. */
+static u32 bbr_bw_filter_rtts(const struct sock *sk)
+{
+    const struct bbr *bbr = inet_csk_ca(sk);
+
+    return max_t(u32, bbr_bw_rtts, bbr->probe_rounds + 2);
+}
 
 static void bbr_drain_to_target_cycling(struct sock *sk,
                                                     const struct rate_sample *rs)
@@ -241,10 +296,11 @@ static void bbr_drain_to_target_cycling(struct sock *sk,
         return;
 
     /* Always need to probe for bw before we forget good bw estimate. */
-    if (elapsed_us > bbr->cycle_len * bbr->min_rtt_us) {
-        /* Start a new PROBE_BW probing cycle of [2 to 8] x min_rtt. */
+    if (elapsed_us > bbr->probe_rounds * bbr->min_rtt_us) {
+        /* Start a new PROBE_BW probing cycle of [2 to 63] x min_rtt. */
         bbr->cycle_mstamp = tp->delivered_mstamp;
         bbr->cycle_len = CYCLE_LEN - prandom_u32_max(bbr_cycle_rand);
+        bbr_pick_probe_rounds(sk);
         bbr_set_cycle_idx(sk, BBR_BW_PROBE_UP);  /* probe bandwidth */
         return;
     }
@@ -842,7 +898,8 @@ static void bbr_update_bw(struct sock *sk, const struct rate_sample *rs)
      */
     if (!rs->is_app_limited || bw >= bbr_max_bw(sk)) {
         /* Incorporate new sample into our max bw filter. */
-        minmax_running_max(&bbr->bw, bbr_bw_rtts, bbr->rtt_cnt, bw);
+        minmax_running_max(&bbr->bw, bbr_bw_filter_rtts(sk), bbr->rtt_cnt,
+                           bw);
     }
 }
 
@@ -1065,6 +1122,7 @@ static void bbr_init(struct sock *sk)
     bbr->cycle_mstamp = 0;
     bbr->cycle_idx = 0;
     bbr->cycle_len = 0;
+    bbr->probe_rounds = 0;
     bbr_reset_lt_bw_sampling(sk);
     bbr_reset_startup_mode(sk);
     bbr->ack_epoch_mstamp = tp->tcp_mstamp;
@@ -1,7 +1,11 @@
 from testbed import *
-from itertools import combinations, permutations
+from itertools import combinations, permutations, product
+from simulator.fluid_model import simulate, prune, grid_configs
+from util import set_cc_module_param
 
 t = CCTest()
+# keep logs on tmpfs during runs and compress them into logs/ in background
+# t = CCTest(offload_logs=True)
 """Functions to help do multi tests in one line
 """
 def test_single_algo_multi_delay(n=2, duration=30, bw=10, loss=0):
@@ -33,6 +37,119 @@ def test_multi_algo_multi_hosts(cc1, cc2, duration=30, bw=10, loss=3, delay='20m
         t.test_multi_cc(cc1, cc2, cc1_host_n=cc1_host_n, cc2_host_n=cc2_host_n,
                         duration=duration, bw=bw, delay=delay, loss=loss, start_delay=start_delay)
 
+def test_probe_cadence_multi_delay(cc1='bbrplus', cc2='cubic', duration=60, bw=100, loss=0,
+                                   delays=['2ms', '10ms', '40ms', '100ms', '200ms']):
+    """sweep the delay (so the BDP) to check the probing cadence of cc1:
+    utilization of a single flow, and fairness when sharing with one cc2 flow
+    """
+    for delay in delays:
+        t.test_single_cc(cc1, n=1, duration=duration, bw=bw, delay=delay, loss=loss)
+        t.test_multi_cc(cc1, cc2, cc1_host_n=1, cc2_host_n=1, duration=duration, bw=bw, delay=delay, loss=loss)
+
+def test_rtt_fairness(algo=['bbr', 'cubic'], duration=60, bw=10, loss=0,
+                      delays_list=[['10ms', '50ms'], ['10ms', '100ms'], ['10ms', '200ms']]):
+    """flows of the same algorithm with short and long RTTs share the bottleneck"""
+    for delays in delays_list:
+        for ctype in algo:
+            t.test_single_cc(ctype, n=len(delays), duration=duration, bw=bw, loss=loss, delays=delays)
+
+def test_rtt_fairness_multi_algo(cc1, cc2, duration=60, bw=10, loss=0, delays_list=[['10ms', '100ms'], ['100ms', '10ms']]):
+    """one cc1 flow and one cc2 flow with different RTTs, in both assignments"""
+    for delays in delays_list:
+        t.test_multi_cc(cc1, cc2, cc1_host_n=1, cc2_host_n=1, duration=duration, bw=bw, loss=loss, delays=delays)
+
+def test_rtt_fairness_pruned(algo=['bbr', 'bbr2', 'cubic'], duration=60, bw=[10, 100], loss=[0, 1], top=5,
+                             delays_list=[['10ms', '50ms'], ['10ms', '100ms'], ['10ms', '200ms'], ['50ms', '200ms']]):
+    """simulate the whole rtt fairness grid with the coarse fluid model first, the most unfair candidates again
+    at the fine step, only run the top most unfair configurations on the testbed
+    """
+    configs = grid_configs(cctypes=[[_, _] for _ in algo], bw=bw, loss=loss, delays=delays_list, duration=[duration])
+    candidates = sorted(prune(configs), key=lambda x: x['fairness'])[:top * 4]
+    _, summary = simulate([_['config'] for _ in candidates])
+    summary = sorted(summary, key=lambda x: x['fairness'])
+    for row in summary[:top]:
+        config = row['config']
+        print_t("info", f"simulated fairness {row['fairness']:.2f}: {config}")
+        t.test_single_cc(config['cctypes'][0], n=2, duration=duration, bw=config['bw'], loss=config['loss'],
+                         delays=config['delays'])
+
+def test_route_change(algo=['bbr', 'bbr2'], duration=60, bw=100, loss=0, delay='10ms',
+                      added_delays=['20ms', '50ms', '100ms'], step_at=20):
+    """move the bottleneck to a longer path at step_at seconds, with the min_rtt route change detection
+    (min_rtt_shift_rounds module parameter, off by default) off and on, to see how much throughput comes
+    back before the 10s min_rtt window would have expired
+    """
+    for added in added_delays:
+        for ctype in algo:
+            for rounds in [0, 2]:
+                set_cc_module_param(ctype, 'min_rtt_shift_rounds', rounds)
+                t.test_single_cc(ctype, n=1, duration=duration, bw=bw, delay=delay, loss=loss,
+                                 delay_steps=[(step_at, added)])
+            set_cc_module_param(ctype, 'min_rtt_shift_rounds', 0)
+
+def test_ecn_fabric(algo=['bbr2', 'bbr2_ecn', 'cubic'], n=2, duration=30, bw=100, delay='1ms', thresholds=[20, 65]):
+    """datacenter like short RTT bottleneck with DCTCP style ECN marking at each threshold(packets), the
+    queue depth is sampled(trace_state) to compare how far each algorithm keeps the queue below the threshold
+    """
+    for threshold in thresholds:
+        ecn_test = CCTest(trace_state=True, ecn_threshold=threshold)
+        for ctype in algo:
+            ecn_test.test_single_cc(ctype, n=n, duration=duration, bw=bw, delay=delay)
+
+def test_incast_fan_in(algo=['cubic', 'bbr', 'bbr2'], fan_in=[4, 8, 16, 32], response_size=65536, bw=100, delay='1ms',
+                       requests=100):
+    """request completion time and bottleneck drops as more responders answer the same request"""
+    for n in fan_in:
+        for ctype in algo:
+            t.test_incast(ctype, n=n, response_size=response_size, bw=bw, delay=delay, requests=requests)
+
+def test_cross_traffic(algo=['bbr', 'bbr2', 'cubic'], n=2, duration=60, bw=100, delay='40ms', trace=None):
+    """the tested flows share the bottleneck with background traffic that doesn't back off: an on/off UDP
+    source alone, short Pareto sized TCP flows alone, both, and a recorded packet trace if given
+    """
+    mixes = [{'udp_rate': 30, 'mean_on': 0.5, 'mean_off': 1.5},
+             {'flow_rate': 10, 'flow_size': 200000},
+             {'udp_rate': 30, 'mean_on': 0.5, 'mean_off': 1.5, 'flow_rate': 10, 'flow_size': 200000}]
+    if trace:
+        mixes.append({'trace': trace})
+    for cross_traffic in mixes:
+        for ctype in algo:
+            t.test_single_cc(ctype, n=n, duration=duration, bw=bw, delay=delay, cross_traffic=cross_traffic)
+
+def test_video_streaming(algo=['bbr', 'bbr2', 'cubic'], duration=60, bw=20, delay='40ms'):
+    """app limited senders: a video player alone, a video player next to a greedy flow, and a 5Mbps capped
+    stream next to a greedy flow, the players record segment download times and stalls
+    """
+    video = {'type': 'video', 'ladder': [1000, 2500, 5000, 8000], 'segment': 2, 'max_buffer': 12}
+    for workloads in [[video], [video, {'type': 'bulk'}], [{'type': 'cbr', 'rate': 5}, {'type': 'bulk'}]]:
+        for ctype in algo:
+            t.test_single_cc(ctype, n=len(workloads), duration=duration, bw=bw, delay=delay, workloads=workloads)
+
+def test_sender_stack(algo=['bbr', 'bbr2'], n=1, duration=30, bw=1000, delay='10ms'):
+    """sweep the sender stack(qdisc, offload, TSQ limit) with tcpgen, which records the sender cpu time next to
+    the throughput in analysis_send.csv(cpu_us), to find the configuration with the most throughput per cpu
+    """
+    stacks = [{'qdisc': 'fq'}, {'qdisc': 'fq_codel'}, {'qdisc': 'pfifo_fast'},
+              {'qdisc': 'fq', 'tso': False, 'gso': False},
+              {'qdisc': 'fq', 'tcp_limit_output_bytes': 131072}, {'qdisc': 'fq', 'tcp_limit_output_bytes': 1048576},
+              {'qdisc': 'fq', 'tcp_wmem': '4096 65536 16777216'}]
+    stack_test = CCTest(switch_type="bridge", shape_access=False, traffic_generator="tcpgen")
+    for sender_stack in stacks:
+        for ctype in algo:
+            stack_test.test_single_cc(ctype, n=n, duration=duration, bw=bw, delay=delay, sender_stack=sender_stack)
+    stack_test.close()
+
+def test_calibration(algo=['bbr', 'bbr2', 'cubic'], duration=30, bw=[10, 100], delay=['10ms', '40ms'], loss=[0, 1]):
+    """ground truth for simulator/calibrate.py: each algorithm alone, two flows of it and against cubic over the
+    bw x delay x loss grid, the same configurations are then replayed by the fluid model
+    """
+    for b, d, l in product(bw, delay, loss):
+        for ctype in algo:
+            t.test_single_cc(ctype, n=1, duration=duration, bw=b, delay=d, loss=l)
+            t.test_single_cc(ctype, n=2, duration=duration, bw=b, delay=d, loss=l, start_delay=5)
+            if ctype != 'cubic':
+                t.test_multi_cc(ctype, 'cubic', duration=duration, bw=b, delay=d, loss=l)
+
 if __name__ == '__main__':
     # test bbr and cubic performances under different loss rate
     test_single_algo_multi_loss(n=1, algo=['bbr', 'cubic'])
@@ -49,3 +166,33 @@ if __name__ == '__main__':
     test_multi_algo_multi_hosts('cubic', 'bbr', loss=3)
     # test_multi_algo_multi_hosts('cubic', 'bbr', loss=5)
 
+    # test bbrplus BDP-scaled probing cadence against cubic
+    # test_probe_cadence_multi_delay('bbrplus', 'cubic')
+
+    # RTT unfairness between short and long RTT flows
+    # test_rtt_fairness(algo=['bbr', 'cubic'])
+    # test_rtt_fairness_multi_algo('bbr', 'cubic')
+    # test_rtt_fairness_pruned()
+
+    # throughput after a route change to a longer path
+    # test_route_change()
+
+    # bbr2 with ECN against a DCTCP marking bottleneck
+    # test_ecn_fabric()
+
+    # many responders answering one request at once
+    # test_incast_fan_in()
+
+    # throughput and fairness next to unresponsive and short lived background traffic
+    # test_cross_traffic()
+
+    # video players and rate capped streams instead of greedy flows
+    # test_video_streaming()
+
+    # sender qdisc, offload and TSQ settings against throughput per cpu
+    # test_sender_stack()
+
+    # matched scenarios to fit the fluid model against
+    # test_calibration()
+    
+    t.close()
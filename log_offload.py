@@ -0,0 +1,83 @@
+import os
+import gzip
+import shutil
+import queue
+import threading
+from util import print_t
+
+STAGING_PATH = '/dev/shm/cctest_logs/'
+
+
+class LogOffloader():
+    """Keep the monitor and iperf logs of a running experiment on tmpfs, and move finished
+    experiments into the persistent logs dir in a background thread, gzipped.
+
+    Usage:
+        offloader = LogOffloader('logs/')
+        dirname = offloader.staging_dir(name)   # write logs here during the run
+        offloader.submit(dirname)               # after net.stop()
+        offloader.close()                       # wait for everything to be on disk
+    """
+    def __init__(self, dest_path, staging_path=STAGING_PATH, max_pending=2, compress=True):
+        """
+        Args:
+            dest_path (str): the persistent logs dir, e.g. 'logs/'
+            staging_path (str, optional): tmpfs dir the experiments write to. Defaults to STAGING_PATH.
+            max_pending (int, optional): finished experiments allowed to wait in memory. If the worker falls behind,
+                submit blocks until one is written out, so tmpfs never holds more than max_pending + 2 experiments
+                (the waiting ones, the one being written out and the one running).
+                Defaults to 2.
+            compress (bool, optional): gzip every log file when moving it. Defaults to True.
+        """
+        self.dest_path = dest_path
+        self.staging_path = staging_path
+        self.compress = compress
+        self.pending = queue.Queue(maxsize=max_pending)
+        os.makedirs(self.staging_path, exist_ok=True)
+        self.worker = threading.Thread(target=self._work, daemon=True)
+        self.worker.start()
+
+    def staging_dir(self, name):
+        """create and return the tmpfs dir of experiment name"""
+        dirname = os.path.join(self.staging_path, name)
+        os.makedirs(dirname, exist_ok=True)
+        return dirname
+
+    def submit(self, dirname):
+        """queue a finished staging dir to be moved, block if max_pending dirs are already waiting"""
+        if self.pending.full():
+            print_t("warning", f"log offload is behind, waiting before next experiment")
+        self.pending.put(dirname)
+
+    def discard(self, dirname):
+        """drop a staging dir without saving it"""
+        shutil.rmtree(dirname, ignore_errors=True)
+
+    def close(self):
+        """wait until every submitted dir is moved and stop the worker"""
+        self.pending.put(None)
+        self.worker.join()
+
+    def _work(self):
+        while True:
+            dirname = self.pending.get()
+            if dirname is None:
+                return
+            try:
+                self._move(dirname)
+            except Exception as e:
+                # keep the staging dir so the logs are not lost
+                print_t("warning", f"log offload failed for {dirname}: {e}")
+
+    def _move(self, dirname):
+        target = os.path.join(self.dest_path, os.path.basename(os.path.normpath(dirname)))
+        os.makedirs(target, exist_ok=True)
+        for filename in os.listdir(dirname):
+            source = os.path.join(dirname, filename)
+            # metadata stays plain so it can be read by hand
+            if self.compress and filename != 'metadata.json':
+                with open(source, 'rb') as fin, gzip.open(os.path.join(target, filename + '.gz'), 'wb') as fout:
+                    shutil.copyfileobj(fin, fout)
+            else:
+                shutil.copy(source, os.path.join(target, filename))
+        shutil.rmtree(dirname)
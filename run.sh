@@ -3,10 +3,17 @@ sudo apt-get update
 sudo apt-get install git
 sudo apt-get install ifstat
 sudo apt-get install ethstats
+sudo apt-get install bridge-utils
+sudo apt-get install ethtool
 git clone https://github.com/sunyiwei24601/CopaReproduce.git
 sudo apt-get install python3-pip
 sudo pip3 install mininet
 
+# build the in tree traffic generator used by CCTest(traffic_generator="tcpgen")
+gcc -O2 -Wall -o tools/tcpgen tools/tcpgen.c
+# and the background traffic of the cross_traffic option
+gcc -O2 -Wall -o tools/crossgen tools/crossgen.c -lm
+
 # install mininet tools
 git clone https://github.com/mininet/mininet
 sudo mininet/util/install.sh -a
@@ -0,0 +1,705 @@
+"""BBR v1 congestion control of many flows, following bbr/tcp_bbr.c.
+
+BbrFlow is the scalar reference: one object per socket, one call per ACK, the same integer
+arithmetic as the kernel. BbrBatch keeps the same fields in structure-of-arrays layout(one numpy
+array per field of struct bbr / tcp_sock) and runs bbr_main for every flow of a batch with array
+operations, so thousands of flows advance in a few vectorized calls. validate() checks that both
+give identical state on the same ACK stream.
+
+Not modelled: the long-term(policer) bw estimator lt_bw, loss recovery cwnd handling(packet
+conservation), idle restarts(flows are always backlogged) and the min_rtt route change detection.
+BbrFlow also follows the round_aggregate module parameter, validate_round_aggregate() replays a recorded
+ACK trace through it with and without and checks every decision is the same.
+"""
+import os
+import numpy as np
+
+BW_SCALE = 24
+BW_UNIT = 1 << BW_SCALE
+BBR_SCALE = 8
+BBR_UNIT = 1 << BBR_SCALE
+STARTUP, DRAIN, PROBE_BW, PROBE_RTT = 0, 1, 2, 3
+CYCLE_LEN = 8
+BW_RTTS = CYCLE_LEN + 2
+MIN_RTT_WIN_SEC = 10
+PROBE_RTT_MODE_MS = 200
+MIN_TSO_RATE = 1200000
+HIGH_GAIN = BBR_UNIT * 2885 // 1000 + 1
+DRAIN_GAIN = BBR_UNIT * 1000 // 2885
+CWND_GAIN = BBR_UNIT * 2
+PACING_GAIN = [BBR_UNIT * 5 // 4, BBR_UNIT * 3 // 4] + [BBR_UNIT] * 6
+CYCLE_RAND = 7
+CWND_MIN_TARGET = 4
+FULL_BW_THRESH = BBR_UNIT * 5 // 4
+FULL_BW_CNT = 3
+TCP_INIT_CWND = 10
+HZ = 1000
+MSS = 1448
+MTU = 1500
+GSO_MAX_BYTES = 65536 - 1 - 320 # sk_gso_max_size - 1 - MAX_TCP_HEADER
+PACING_SHIFT = 10
+CWND_CLAMP = 0xffffffff
+
+# fields of the rate sample passed to on_ack
+RS_FIELDS = ['delivered', 'interval_us', 'rtt_us', 'prior_delivered', 'prior_in_flight', 'acked_sacked',
+             'losses', 'is_app_limited', 'rand']
+# per flow state compared by validate
+STATE_FIELDS = ['min_rtt_us', 'min_rtt_stamp', 'probe_rtt_done_stamp', 'rtt_cnt', 'next_rtt_delivered',
+                'cycle_mstamp', 'mode', 'restore_cwnd', 'round_start', 'tso_segs_goal', 'probe_rtt_round_done',
+                'pacing_gain', 'cwnd_gain', 'full_bw_cnt', 'cycle_idx', 'prior_cwnd', 'full_bw',
+                'bw_t', 'bw_v', 'snd_cwnd', 'pacing_rate', 'delivered', 'app_limited']
+# per ACK outputs compared by validate_round_aggregate
+DECISION_FIELDS = ['mode', 'cycle_idx', 'pacing_gain', 'cwnd_gain', 'snd_cwnd', 'pacing_rate', 'min_rtt_us',
+                   'rtt_cnt', 'full_bw_cnt', 'prior_cwnd']
+
+
+def rate_bytes_per_sec(rate, gain):
+    """bbr_rate_bytes_per_sec, works on ints and int64 arrays"""
+    return (((rate * MTU * gain) >> BBR_SCALE) * 1000000) >> BW_SCALE
+
+def tso_autosize(pacing_rate, min_segs):
+    """tcp_tso_autosize"""
+    return np.maximum(np.minimum(pacing_rate >> PACING_SHIFT, GSO_MAX_BYTES) // MSS, min_segs)
+
+class BbrFlow():
+    """scalar reference, one tcp_bbr.c socket"""
+    def __init__(self, srtt_us, now_us=0, round_aggregate=False):
+        self.round_aggregate = round_aggregate
+        self.quiet_acks = 0
+        self.snd_cwnd = TCP_INIT_CWND
+        self.delivered = 0
+        self.delivered_mstamp = now_us
+        self.app_limited = 0
+        self.prior_cwnd = 0
+        self.tso_segs_goal = 0
+        self.rtt_cnt = 0
+        self.next_rtt_delivered = 0
+        self.probe_rtt_done_stamp = 0
+        self.probe_rtt_round_done = 0
+        self.min_rtt_us = srtt_us
+        self.min_rtt_stamp = now_us * HZ // 1000000
+        # struct minmax, three (t, v) samples
+        self.bw_t = [0, 0, 0]
+        self.bw_v = [0, 0, 0]
+        self.restore_cwnd = 0
+        self.round_start = 0
+        self.full_bw = 0
+        self.full_bw_cnt = 0
+        self.cycle_mstamp = 0
+        self.cycle_idx = 0
+        # bbr_init_pacing_rate_from_rtt
+        bw = self.snd_cwnd * BW_UNIT // max(srtt_us, 1)
+        self.pacing_rate = rate_bytes_per_sec(bw, HIGH_GAIN)
+        self.mode = STARTUP
+        self.pacing_gain = HIGH_GAIN
+        self.cwnd_gain = HIGH_GAIN
+
+    def full_bw_reached(self):
+        return self.full_bw_cnt >= FULL_BW_CNT
+
+    def max_bw(self):
+        return self.bw_v[0]
+
+    def minmax_running_max(self, win, t, meas):
+        """win_minmax.c"""
+        if meas >= self.bw_v[0] or t - self.bw_t[2] > win:
+            self.bw_t = [t, t, t]
+            self.bw_v = [meas, meas, meas]
+            return
+        if meas >= self.bw_v[1]:
+            self.bw_t[2] = self.bw_t[1] = t
+            self.bw_v[2] = self.bw_v[1] = meas
+        elif meas >= self.bw_v[2]:
+            self.bw_t[2], self.bw_v[2] = t, meas
+        dt = t - self.bw_t[0]
+        if dt > win:
+            self.bw_t = self.bw_t[1:] + [t]
+            self.bw_v = self.bw_v[1:] + [meas]
+            if t - self.bw_t[0] > win:
+                self.bw_t = self.bw_t[1:] + [t]
+                self.bw_v = self.bw_v[1:] + [meas]
+        elif self.bw_t[1] == self.bw_t[0] and dt > win // 4:
+            self.bw_t[2] = self.bw_t[1] = t
+            self.bw_v[2] = self.bw_v[1] = meas
+        elif self.bw_t[2] == self.bw_t[1] and dt > win // 2:
+            self.bw_t[2], self.bw_v[2] = t, meas
+
+    def target_cwnd(self, bw, gain):
+        w = bw * self.min_rtt_us
+        cwnd = (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) // BW_UNIT
+        cwnd += 3 * self.tso_segs_goal
+        return (cwnd + 1) & ~1
+
+    def advance_cycle_phase(self):
+        self.cycle_idx = (self.cycle_idx + 1) & (CYCLE_LEN - 1)
+        self.cycle_mstamp = self.delivered_mstamp
+        self.pacing_gain = PACING_GAIN[self.cycle_idx]
+
+    def reset_probe_bw_mode(self, rand):
+        self.mode = PROBE_BW
+        self.pacing_gain = BBR_UNIT
+        self.cwnd_gain = CWND_GAIN
+        self.cycle_idx = CYCLE_LEN - 1 - rand % CYCLE_RAND
+        self.advance_cycle_phase()
+
+    def update_bw(self, rs):
+        self.round_start = 0
+        if rs['delivered'] < 0 or rs['interval_us'] <= 0:
+            return
+        if rs['prior_delivered'] >= self.next_rtt_delivered:
+            self.next_rtt_delivered = self.delivered
+            self.rtt_cnt += 1
+            self.round_start = 1
+        bw = rs['delivered'] * BW_UNIT // rs['interval_us']
+        if not rs['is_app_limited'] or bw >= self.max_bw():
+            self.minmax_running_max(BW_RTTS, self.rtt_cnt, bw)
+
+    def quiet_ack(self, rs, jiffies):
+        """bbr_quiet_ack, True if the model update can be skipped"""
+        if (self.mode != PROBE_BW or self.pacing_gain != BBR_UNIT or rs['losses'] or rs['delivered'] < 0
+                or rs['interval_us'] <= 0 or rs['prior_delivered'] >= self.next_rtt_delivered):
+            return False
+        if (self.delivered_mstamp - self.cycle_mstamp > self.min_rtt_us
+                or 0 <= rs['rtt_us'] <= self.min_rtt_us or jiffies > self.min_rtt_stamp + MIN_RTT_WIN_SEC * HZ):
+            return False
+        bw = rs['delivered'] * BW_UNIT // rs['interval_us']
+        if bw >= self.max_bw():
+            return False
+        self.round_start = 0
+        if not rs['is_app_limited']:
+            self.minmax_running_max(BW_RTTS, self.rtt_cnt, bw)
+        self.quiet_acks += 1
+        return True
+
+    def update_cycle_phase(self, rs):
+        if self.mode != PROBE_BW:
+            return
+        is_full_length = self.delivered_mstamp - self.cycle_mstamp > self.min_rtt_us
+        if self.pacing_gain == BBR_UNIT:
+            advance = is_full_length
+        elif self.pacing_gain > BBR_UNIT:
+            advance = is_full_length and (rs['losses'] > 0 or
+                rs['prior_in_flight'] >= self.target_cwnd(self.max_bw(), self.pacing_gain))
+        else:
+            advance = is_full_length or rs['prior_in_flight'] <= self.target_cwnd(self.max_bw(), BBR_UNIT)
+        if advance:
+            self.advance_cycle_phase()
+
+    def check_full_bw_reached(self, rs):
+        if self.full_bw_reached() or not self.round_start or rs['is_app_limited']:
+            return
+        if self.max_bw() >= self.full_bw * FULL_BW_THRESH >> BBR_SCALE:
+            self.full_bw = self.max_bw()
+            self.full_bw_cnt = 0
+            return
+        self.full_bw_cnt += 1
+
+    def check_drain(self, rs, inflight):
+        if self.mode == STARTUP and self.full_bw_reached():
+            self.mode = DRAIN
+            self.pacing_gain = DRAIN_GAIN
+            self.cwnd_gain = HIGH_GAIN
+        if self.mode == DRAIN and inflight <= self.target_cwnd(self.max_bw(), BBR_UNIT):
+            self.reset_probe_bw_mode(rs['rand'])
+
+    def update_min_rtt(self, rs, inflight, jiffies):
+        filter_expired = jiffies > self.min_rtt_stamp + MIN_RTT_WIN_SEC * HZ
+        if rs['rtt_us'] >= 0 and (rs['rtt_us'] <= self.min_rtt_us or filter_expired):
+            self.min_rtt_us = rs['rtt_us']
+            self.min_rtt_stamp = jiffies
+        if filter_expired and self.mode != PROBE_RTT:
+            self.mode = PROBE_RTT
+            self.pacing_gain = BBR_UNIT
+            self.cwnd_gain = BBR_UNIT
+            # bbr_save_cwnd, mode is already PROBE_RTT here
+            self.prior_cwnd = max(self.prior_cwnd, self.snd_cwnd)
+            self.probe_rtt_done_stamp = 0
+        if self.mode == PROBE_RTT:
+            self.app_limited = (self.delivered + inflight) or 1
+            if not self.probe_rtt_done_stamp and inflight <= CWND_MIN_TARGET:
+                self.probe_rtt_done_stamp = jiffies + PROBE_RTT_MODE_MS * HZ // 1000
+                self.probe_rtt_round_done = 0
+                self.next_rtt_delivered = self.delivered
+            elif self.probe_rtt_done_stamp:
+                if self.round_start:
+                    self.probe_rtt_round_done = 1
+                if self.probe_rtt_round_done and jiffies > self.probe_rtt_done_stamp:
+                    self.min_rtt_stamp = jiffies
+                    self.restore_cwnd = 1
+                    if self.full_bw_reached():
+                        self.reset_probe_bw_mode(rs['rand'])
+                    else:
+                        self.mode, self.pacing_gain, self.cwnd_gain = STARTUP, HIGH_GAIN, HIGH_GAIN
+
+    def set_cwnd(self, rs, bw):
+        acked = rs['acked_sacked']
+        if not acked:
+            return
+        cwnd = self.snd_cwnd
+        if rs['losses'] > 0:
+            cwnd = max(cwnd - rs['losses'], 1)
+        if self.restore_cwnd:
+            cwnd = max(cwnd, self.prior_cwnd)
+            self.restore_cwnd = 0
+        target = self.target_cwnd(bw, self.cwnd_gain)
+        if self.full_bw_reached():
+            cwnd = min(cwnd + acked, target)
+        elif cwnd < target or self.delivered < TCP_INIT_CWND:
+            cwnd = cwnd + acked
+        cwnd = max(cwnd, CWND_MIN_TARGET)
+        self.snd_cwnd = min(cwnd, CWND_CLAMP)
+        if self.mode == PROBE_RTT:
+            self.snd_cwnd = min(self.snd_cwnd, CWND_MIN_TARGET)
+
+    def on_ack(self, rs, inflight, now_us):
+        """tcp_ack -> tcp_rate_gen -> bbr_main for one ACK
+
+        Args:
+            rs (dict): rate sample, keys RS_FIELDS
+            inflight (int): packets in flight after this ACK
+            now_us (int): time of the ACK
+        """
+        self.delivered += rs['acked_sacked']
+        self.delivered_mstamp = now_us
+        if self.app_limited and self.delivered > self.app_limited:
+            self.app_limited = 0
+        jiffies = now_us * HZ // 1000000
+
+        if not (self.round_aggregate and self.quiet_ack(rs, jiffies)):
+            self.update_bw(rs)
+            self.update_cycle_phase(rs)
+            self.check_full_bw_reached(rs)
+            self.check_drain(rs, inflight)
+            self.update_min_rtt(rs, inflight, jiffies)
+
+        bw = self.max_bw()
+        rate = rate_bytes_per_sec(bw, self.pacing_gain)
+        if self.full_bw_reached() or rate > self.pacing_rate:
+            self.pacing_rate = rate
+        min_segs = 1 if self.pacing_rate < (MIN_TSO_RATE >> 3) else 2
+        self.tso_segs_goal = int(min(tso_autosize(self.pacing_rate, min_segs), 0x7F))
+        self.set_cwnd(rs, bw)
+
+class BbrBatch():
+    """the same socket state in structure-of-arrays layout, one element per flow"""
+    def __init__(self, srtt_us, now_us=0):
+        """
+        Args:
+            srtt_us (np.array): handshake RTT of every flow in microsecond
+            now_us (int, optional): creation time. Defaults to 0.
+        """
+        srtt_us = np.asarray(srtt_us, dtype=np.int64)
+        n = len(srtt_us)
+        zeros = lambda: np.zeros(n, dtype=np.int64)
+        self.n = n
+        self.snd_cwnd = np.full(n, TCP_INIT_CWND, dtype=np.int64)
+        self.delivered = zeros()
+        self.delivered_mstamp = np.full(n, now_us, dtype=np.int64)
+        self.app_limited = zeros()
+        self.prior_cwnd = zeros()
+        self.tso_segs_goal = zeros()
+        self.rtt_cnt = zeros()
+        self.next_rtt_delivered = zeros()
+        self.probe_rtt_done_stamp = zeros()
+        self.probe_rtt_round_done = zeros()
+        self.min_rtt_us = srtt_us.copy()
+        self.min_rtt_stamp = np.full(n, now_us * HZ // 1000000, dtype=np.int64)
+        self.bw_t = np.zeros((n, 3), dtype=np.int64)
+        self.bw_v = np.zeros((n, 3), dtype=np.int64)
+        self.restore_cwnd = zeros()
+        self.round_start = zeros()
+        self.full_bw = zeros()
+        self.full_bw_cnt = zeros()
+        self.cycle_mstamp = zeros()
+        self.cycle_idx = zeros()
+        self.pacing_rate = rate_bytes_per_sec(self.snd_cwnd * BW_UNIT // np.maximum(srtt_us, 1), HIGH_GAIN)
+        self.mode = np.full(n, STARTUP, dtype=np.int64)
+        self.pacing_gain = np.full(n, HIGH_GAIN, dtype=np.int64)
+        self.cwnd_gain = np.full(n, HIGH_GAIN, dtype=np.int64)
+
+    def extend(self, srtt_us, now_us):
+        """append new flows created at now_us"""
+        new = BbrBatch(srtt_us, now_us)
+        for name, value in vars(self).items():
+            if isinstance(value, np.ndarray):
+                setattr(self, name, np.concatenate([value, getattr(new, name)]))
+        self.n += new.n
+
+    def target_cwnd(self, bw, gain):
+        w = bw * self.min_rtt_us
+        cwnd = (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) // BW_UNIT
+        cwnd += 3 * self.tso_segs_goal
+        return (cwnd + 1) & ~1
+
+    def advance_cycle_phase(self, m):
+        self.cycle_idx = np.where(m, (self.cycle_idx + 1) & (CYCLE_LEN - 1), self.cycle_idx)
+        self.cycle_mstamp = np.where(m, self.delivered_mstamp, self.cycle_mstamp)
+        self.pacing_gain = np.where(m, np.array(PACING_GAIN)[self.cycle_idx], self.pacing_gain)
+
+    def reset_probe_bw_mode(self, m, rand):
+        self.mode = np.where(m, PROBE_BW, self.mode)
+        self.pacing_gain = np.where(m, BBR_UNIT, self.pacing_gain)
+        self.cwnd_gain = np.where(m, CWND_GAIN, self.cwnd_gain)
+        self.cycle_idx = np.where(m, CYCLE_LEN - 1 - rand % CYCLE_RAND, self.cycle_idx)
+        self.advance_cycle_phase(m)
+
+    def minmax_running_max(self, m, win, t, meas):
+        s_t, s_v = self.bw_t, self.bw_v
+        reset = m & ((meas >= s_v[:, 0]) | (t - s_t[:, 2] > win))
+        rest = m & ~reset
+        up1 = rest & (meas >= s_v[:, 1])
+        up2 = rest & ~up1 & (meas >= s_v[:, 2])
+        s_t[up1, 1] = s_t[up1, 2] = t[up1]
+        s_v[up1, 1] = s_v[up1, 2] = meas[up1]
+        s_t[up2, 2] = t[up2]
+        s_v[up2, 2] = meas[up2]
+        # minmax_subwin_update
+        dt = t - s_t[:, 0]
+        shift = rest & (dt > win)
+        quarter = rest & ~shift & (s_t[:, 1] == s_t[:, 0]) & (dt > win // 4)
+        half = rest & ~shift & ~quarter & (s_t[:, 2] == s_t[:, 1]) & (dt > win // 2)
+        for _ in range(2):
+            s_t[shift] = np.column_stack([s_t[shift, 1], s_t[shift, 2], t[shift]])
+            s_v[shift] = np.column_stack([s_v[shift, 1], s_v[shift, 2], meas[shift]])
+            shift &= t - s_t[:, 0] > win
+        s_t[quarter, 1] = s_t[quarter, 2] = t[quarter]
+        s_v[quarter, 1] = s_v[quarter, 2] = meas[quarter]
+        s_t[half, 2] = t[half]
+        s_v[half, 2] = meas[half]
+        s_t[reset] = t[reset, None]
+        s_v[reset] = meas[reset, None]
+
+    def on_ack(self, rs, inflight, now_us, m=None):
+        """BbrFlow.on_ack for every flow in mask m at once, rs fields and inflight are arrays of n flows"""
+        if m is None:
+            m = np.ones(self.n, dtype=bool)
+        acked = rs['acked_sacked']
+        self.delivered = np.where(m, self.delivered + acked, self.delivered)
+        self.delivered_mstamp = np.where(m, now_us, self.delivered_mstamp)
+        self.app_limited = np.where(m & (self.app_limited > 0) & (self.delivered > self.app_limited), 0, self.app_limited)
+        jiffies = now_us * HZ // 1000000
+
+        # bbr_update_bw
+        self.round_start = np.where(m, 0, self.round_start)
+        valid = m & (rs['delivered'] >= 0) & (rs['interval_us'] > 0)
+        new_round = valid & (rs['prior_delivered'] >= self.next_rtt_delivered)
+        self.next_rtt_delivered = np.where(new_round, self.delivered, self.next_rtt_delivered)
+        self.rtt_cnt = self.rtt_cnt + new_round
+        self.round_start = np.where(new_round, 1, self.round_start)
+        bw = rs['delivered'] * BW_UNIT // np.maximum(rs['interval_us'], 1)
+        take = valid & (~rs['is_app_limited'].astype(bool) | (bw >= self.bw_v[:, 0]))
+        self.minmax_running_max(take, BW_RTTS, self.rtt_cnt, bw)
+
+        # bbr_update_cycle_phase
+        max_bw = self.bw_v[:, 0]
+        is_full_length = self.delivered_mstamp - self.cycle_mstamp > self.min_rtt_us
+        advance = np.where(self.pacing_gain == BBR_UNIT, is_full_length,
+                  np.where(self.pacing_gain > BBR_UNIT,
+                           is_full_length & ((rs['losses'] > 0) |
+                                             (rs['prior_in_flight'] >= self.target_cwnd(max_bw, self.pacing_gain))),
+                           is_full_length | (rs['prior_in_flight'] <= self.target_cwnd(max_bw, BBR_UNIT))))
+        self.advance_cycle_phase(m & (self.mode == PROBE_BW) & advance)
+
+        # bbr_check_full_bw_reached
+        check = m & (self.full_bw_cnt < FULL_BW_CNT) & (self.round_start > 0) & ~rs['is_app_limited'].astype(bool)
+        grew = max_bw >= self.full_bw * FULL_BW_THRESH >> BBR_SCALE
+        self.full_bw = np.where(check & grew, max_bw, self.full_bw)
+        self.full_bw_cnt = np.where(check, np.where(grew, 0, self.full_bw_cnt + 1), self.full_bw_cnt)
+        full = self.full_bw_cnt >= FULL_BW_CNT
+
+        # bbr_check_drain
+        to_drain = m & (self.mode == STARTUP) & full
+        self.mode = np.where(to_drain, DRAIN, self.mode)
+        self.pacing_gain = np.where(to_drain, DRAIN_GAIN, self.pacing_gain)
+        self.cwnd_gain = np.where(to_drain, HIGH_GAIN, self.cwnd_gain)
+        drained = m & (self.mode == DRAIN) & (inflight <= self.target_cwnd(max_bw, BBR_UNIT))
+        self.reset_probe_bw_mode(drained, rs['rand'])
+
+        # bbr_update_min_rtt
+        expired = m & (jiffies > self.min_rtt_stamp + MIN_RTT_WIN_SEC * HZ)
+        update = m & (rs['rtt_us'] >= 0) & ((rs['rtt_us'] <= self.min_rtt_us) | expired)
+        self.min_rtt_us = np.where(update, rs['rtt_us'], self.min_rtt_us)
+        self.min_rtt_stamp = np.where(update, jiffies, self.min_rtt_stamp)
+        enter = expired & (self.mode != PROBE_RTT)
+        self.mode = np.where(enter, PROBE_RTT, self.mode)
+        self.pacing_gain = np.where(enter, BBR_UNIT, self.pacing_gain)
+        self.cwnd_gain = np.where(enter, BBR_UNIT, self.cwnd_gain)
+        self.prior_cwnd = np.where(enter, np.maximum(self.prior_cwnd, self.snd_cwnd), self.prior_cwnd)
+        self.probe_rtt_done_stamp = np.where(enter, 0, self.probe_rtt_done_stamp)
+        probe_rtt = m & (self.mode == PROBE_RTT)
+        app_limited = self.delivered + inflight
+        self.app_limited = np.where(probe_rtt, np.where(app_limited > 0, app_limited, 1), self.app_limited)
+        start_done = probe_rtt & (self.probe_rtt_done_stamp == 0) & (inflight <= CWND_MIN_TARGET)
+        waiting = probe_rtt & ~start_done & (self.probe_rtt_done_stamp != 0)
+        self.probe_rtt_done_stamp = np.where(start_done, jiffies + PROBE_RTT_MODE_MS * HZ // 1000, self.probe_rtt_done_stamp)
+        self.probe_rtt_round_done = np.where(start_done, 0, self.probe_rtt_round_done)
+        self.next_rtt_delivered = np.where(start_done, self.delivered, self.next_rtt_delivered)
+        self.probe_rtt_round_done = np.where(waiting & (self.round_start > 0), 1, self.probe_rtt_round_done)
+        done = waiting & (self.probe_rtt_round_done > 0) & (jiffies > self.probe_rtt_done_stamp)
+        self.min_rtt_stamp = np.where(done, jiffies, self.min_rtt_stamp)
+        self.restore_cwnd = np.where(done, 1, self.restore_cwnd)
+        self.reset_probe_bw_mode(done & full, rs['rand'])
+        restart = done & ~full
+        self.mode = np.where(restart, STARTUP, self.mode)
+        self.pacing_gain = np.where(restart, HIGH_GAIN, self.pacing_gain)
+        self.cwnd_gain = np.where(restart, HIGH_GAIN, self.cwnd_gain)
+
+        # bbr_set_pacing_rate, bbr_set_tso_segs_goal
+        bw = self.bw_v[:, 0]
+        rate = rate_bytes_per_sec(bw, self.pacing_gain)
+        self.pacing_rate = np.where(m & (full | (rate > self.pacing_rate)), rate, self.pacing_rate)
+        min_segs = np.where(self.pacing_rate < (MIN_TSO_RATE >> 3), 1, 2)
+        self.tso_segs_goal = np.where(m, np.minimum(tso_autosize(self.pacing_rate, min_segs), 0x7F), self.tso_segs_goal)
+
+        # bbr_set_cwnd
+        m = m & (acked > 0)
+        cwnd = np.where(rs['losses'] > 0, np.maximum(self.snd_cwnd - rs['losses'], 1), self.snd_cwnd)
+        restore = m & (self.restore_cwnd > 0)
+        cwnd = np.where(restore, np.maximum(cwnd, self.prior_cwnd), cwnd)
+        self.restore_cwnd = np.where(restore, 0, self.restore_cwnd)
+        target = self.target_cwnd(bw, self.cwnd_gain)
+        cwnd = np.where(full, np.minimum(cwnd + acked, target),
+                        np.where((cwnd < target) | (self.delivered < TCP_INIT_CWND), cwnd + acked, cwnd))
+        cwnd = np.minimum(np.maximum(cwnd, CWND_MIN_TARGET), CWND_CLAMP)
+        cwnd = np.where(self.mode == PROBE_RTT, np.minimum(cwnd, CWND_MIN_TARGET), cwnd)
+        self.snd_cwnd = np.where(m, cwnd, self.snd_cwnd)
+
+class Dumbbell():
+    """many backlogged flows through one bottleneck FIFO, driving a BbrBatch with one aggregated ACK
+    per flow and time step(like stretch ACKs), every flow with its own propagation RTT
+    """
+    def __init__(self, rtt_us, bw_mbps=100, buffer_pkts=1000, dt_us=100, start_us=None, seed=0):
+        """
+        Args:
+            rtt_us (np.array): propagation RTT of every flow in microsecond
+            bw_mbps (int, optional): bottleneck rate. Defaults to 100.
+            buffer_pkts (int, optional): bottleneck queue limit. Defaults to 1000.
+            dt_us (int, optional): time step. Defaults to 100.
+            start_us (np.array, optional): start time of every flow, e.g. all 0 for incast. Defaults to None.
+            seed (int, optional): seed of the random ProbeBW phase. Defaults to 0.
+        """
+        self.rtt_us = np.asarray(rtt_us, dtype=np.int64)
+        self.n = len(self.rtt_us)
+        self.dt_us = dt_us
+        self.capacity = bw_mbps * 1e6 / 8 / MTU * dt_us / 1e6 # packets per step
+        self.buffer = buffer_pkts
+        self.start_us = np.zeros(self.n, dtype=np.int64) if start_us is None else np.asarray(start_us, dtype=np.int64)
+        self.rng = np.random.default_rng(seed)
+        self.engine = BbrBatch(self.rtt_us)
+        self.now = 0
+        self.step_id = 0
+        self.backlog = 0.0
+        self.inflight = np.zeros(self.n, dtype=np.int64)
+        self.credit = np.zeros(self.n)
+        # ACKs in the future: ring of steps, each slot holds acked/lost counts and the newest send step
+        self.horizon = self.needed_horizon()
+        self.ack_count = np.zeros((self.horizon, self.n), dtype=np.int64)
+        self.ack_lost = np.zeros((self.horizon, self.n), dtype=np.int64)
+        self.ack_send = np.full((self.horizon, self.n), -1, dtype=np.int64)
+        # per send step: tp->delivered and app limited flag, for the rate samples
+        self.sent_delivered = np.zeros((self.horizon, self.n), dtype=np.int64)
+        self.sent_app_limited = np.zeros((self.horizon, self.n), dtype=bool)
+        self.prop_steps = self.rtt_us // dt_us
+
+    def needed_horizon(self):
+        """ring length covering the longest RTT plus a full queue"""
+        return int((self.rtt_us.max() + self.buffer / self.capacity * self.dt_us) // self.dt_us) + 2
+
+    def resize_rings(self, horizon, n):
+        """reallocate the rings for a new horizon and n flows, keeping pending ACKs and past sends"""
+        rings = {'ack_count': 0, 'ack_lost': 0, 'ack_send': -1, 'sent_delivered': 0, 'sent_app_limited': False}
+        future = np.arange(self.step_id, self.step_id + self.horizon)
+        past = np.arange(max(self.step_id - self.horizon, 0), self.step_id)
+        for name, fill in rings.items():
+            old = getattr(self, name)
+            new = np.full((horizon, n), fill, dtype=old.dtype)
+            steps = future if name.startswith('ack') else past
+            new[steps % horizon, :self.n] = old[steps % self.horizon]
+            setattr(self, name, new)
+        self.horizon = horizon
+
+    def set_bandwidth(self, bw_mbps):
+        """change the bottleneck rate from now on, e.g. a capacity drop"""
+        self.capacity = bw_mbps * 1e6 / 8 / MTU * self.dt_us / 1e6
+        self.resize_rings(max(self.horizon, self.needed_horizon()), self.n)
+
+    def add_flows(self, rtt_us):
+        """start new flows now, e.g. a flow joining the converged ones"""
+        rtt_us = np.asarray(rtt_us, dtype=np.int64)
+        self.rtt_us = np.concatenate([self.rtt_us, rtt_us])
+        self.resize_rings(max(self.horizon, self.needed_horizon()), self.n + len(rtt_us))
+        self.engine.extend(rtt_us, self.now)
+        self.start_us = np.concatenate([self.start_us, np.full(len(rtt_us), self.now, dtype=np.int64)])
+        self.inflight = np.concatenate([self.inflight, np.zeros(len(rtt_us), dtype=np.int64)])
+        self.credit = np.concatenate([self.credit, np.zeros(len(rtt_us))])
+        self.prop_steps = self.rtt_us // self.dt_us
+        self.n += len(rtt_us)
+
+    def ack_sample(self, slot):
+        """build the rate sample of the ACKs arriving in this step"""
+        acked = self.ack_count[slot].copy()
+        lost = self.ack_lost[slot].copy()
+        send_step = self.ack_send[slot].copy()
+        m = (acked > 0) | (lost > 0)
+        send_slot = np.maximum(send_step, 0) % self.horizon
+        flows = np.arange(self.n)
+        prior_delivered = self.sent_delivered[send_slot, flows]
+        elapsed = (self.step_id - send_step) * self.dt_us
+        rs = {
+            'acked_sacked': acked,
+            'losses': lost,
+            'prior_delivered': prior_delivered,
+            'delivered': self.engine.delivered + acked - prior_delivered,
+            'interval_us': np.where(m, elapsed, 0),
+            'rtt_us': np.where(acked > 0, elapsed, -1),
+            'prior_in_flight': self.inflight.copy(),
+            'is_app_limited': self.sent_app_limited[send_slot, flows],
+            'rand': self.rng.integers(0, 1 << 16, self.n),
+        }
+        self.ack_count[slot] = 0
+        self.ack_lost[slot] = 0
+        self.ack_send[slot] = -1
+        return rs, m
+
+    def step(self, engines=()):
+        """advance one time step, the rate samples are also fed to the extra engines(e.g. BbrFlow for validation)
+
+        Returns:
+            (rs, m): the rate samples and the mask of flows that got an ACK in this step
+        """
+        slot = self.step_id % self.horizon
+        rs, m = self.ack_sample(slot)
+        self.inflight -= rs['acked_sacked'] + rs['losses']
+        self.engine.on_ack(rs, self.inflight, self.now, m)
+        for engine in engines:
+            engine(rs, self.inflight, self.now, m)
+
+        # send paced packets within cwnd
+        active = self.now >= self.start_us
+        self.credit = np.where(active, np.minimum(self.credit + self.engine.pacing_rate * self.dt_us / 1e6 / MTU,
+                                                  self.engine.snd_cwnd), 0)
+        sent = np.minimum(self.credit.astype(np.int64), np.maximum(self.engine.snd_cwnd - self.inflight, 0))
+        self.credit -= sent
+        self.sent_delivered[slot] = self.engine.delivered
+        self.sent_app_limited[slot] = self.engine.app_limited > 0
+
+        # tail drop at the bottleneck, flows arrive in random order within a step
+        total = sent.sum()
+        space = int(max(self.buffer - self.backlog, 0))
+        lost = np.zeros(self.n, dtype=np.int64)
+        if total > space:
+            order = self.rng.permutation(self.n)
+            before = np.cumsum(sent[order]) - sent[order]
+            lost[order] = sent[order] - np.clip(space - before, 0, sent[order])
+        queue_delay = int(self.backlog / self.capacity)
+        self.backlog = max(self.backlog + total - lost.sum() - self.capacity, 0)
+        self.inflight += sent
+
+        # every packet sent in this step is acked(or found lost) after the queue and propagation delay
+        ack_slot = (self.step_id + queue_delay + self.prop_steps) % self.horizon
+        flows = np.arange(self.n)
+        has = sent > 0
+        np.add.at(self.ack_count, (ack_slot[has], flows[has]), (sent - lost)[has])
+        np.add.at(self.ack_lost, (ack_slot[has], flows[has]), lost[has])
+        self.ack_send[ack_slot[has], flows[has]] = self.step_id
+        self.step_id += 1
+        self.now += self.dt_us
+        return rs, m
+
+    def run(self, duration_s, sample_interval_s=0.1):
+        """simulate duration_s seconds, return goodput(Mbps) of every flow per sample interval (T, n)"""
+        steps_per_sample = int(sample_interval_s * 1e6 // self.dt_us)
+        samples = []
+        for _ in range(int(duration_s / sample_interval_s)):
+            delivered = self.engine.delivered.copy()
+            for _ in range(steps_per_sample):
+                self.step()
+            samples.append((self.engine.delivered - delivered) * MSS * 8 / sample_interval_s / 1e6)
+        return np.array(samples)
+
+def validate(n=16, duration_s=12, seed=0, **kwargs):
+    """run a Dumbbell with n flows, feed every rate sample to n scalar BbrFlow too, and compare all
+    STATE_FIELDS after each step. 12 seconds covers STARTUP, DRAIN, ProbeBW and one ProbeRTT.
+
+    Returns:
+        int: number of steps checked, raise AssertionError at the first mismatch
+    """
+    rng = np.random.default_rng(seed)
+    net = Dumbbell(rng.integers(2000, 100000, n), seed=seed, **kwargs)
+    flows = [BbrFlow(int(_)) for _ in net.rtt_us]
+
+    def scalar(rs, inflight, now, m):
+        for i in np.nonzero(m)[0]:
+            flows[i].on_ack({k: int(rs[k][i]) for k in RS_FIELDS}, int(inflight[i]), now)
+
+    steps = int(duration_s * 1e6 // net.dt_us)
+    for step in range(steps):
+        net.step(engines=[scalar])
+        for field in STATE_FIELDS:
+            batch = getattr(net.engine, field)
+            reference = np.array([getattr(_, field) for _ in flows])
+            if not np.array_equal(batch, reference):
+                i = int(np.nonzero((batch != reference).reshape(n, -1).any(axis=1))[0][0])
+                raise AssertionError(f"step {step} flow {i} {field}: batch {batch[i]} scalar {reference[i]}")
+    return steps
+
+def record_trace(filename, n=8, duration_s=12, seed=0, **kwargs):
+    """run a Dumbbell with n flows and save every ACK(flow, time, inflight and rate sample) into filename(.npz),
+    a golden trace to replay through BbrFlow variants
+    """
+    rng = np.random.default_rng(seed)
+    net = Dumbbell(rng.integers(2000, 100000, n), seed=seed, **kwargs)
+    events = {_: [] for _ in ['flow', 'now', 'inflight'] + RS_FIELDS}
+
+    def record(rs, inflight, now, m):
+        flows = np.nonzero(m)[0]
+        events['flow'].append(flows)
+        events['now'].append(np.full(len(flows), now))
+        events['inflight'].append(inflight[flows])
+        for field in RS_FIELDS:
+            events[field].append(rs[field][flows])
+
+    for _ in range(int(duration_s * 1e6 // net.dt_us)):
+        net.step(engines=[record])
+    np.savez_compressed(filename, flow_rtt_us=net.rtt_us, **{k: np.concatenate(v) for k, v in events.items()})
+
+def replay_trace(filename, round_aggregate=False):
+    """feed a golden trace to one BbrFlow per flow
+
+    Returns:
+        (decisions, flows): DECISION_FIELDS and max bw after every ACK (ACKs, fields + 1), and the BbrFlow objects
+    """
+    trace = np.load(filename)
+    flows = [BbrFlow(int(_), round_aggregate=round_aggregate) for _ in trace['flow_rtt_us']]
+    columns = {k: trace[k].tolist() for k in trace.files if k != 'flow_rtt_us'}
+    decisions = np.zeros((len(columns['flow']), len(DECISION_FIELDS) + 1), dtype=np.int64)
+    for i, f in enumerate(columns['flow']):
+        flow = flows[f]
+        flow.on_ack({k: columns[k][i] for k in RS_FIELDS}, columns['inflight'][i], columns['now'][i])
+        decisions[i, :-1] = [getattr(flow, _) for _ in DECISION_FIELDS]
+        decisions[i, -1] = flow.max_bw()
+    return decisions, flows
+
+def validate_round_aggregate(filename='bbr_golden_trace.npz', **kwargs):
+    """replay a golden trace(recorded first if missing) with and without round_aggregate, every decision must be
+    the same on every ACK
+
+    Returns:
+        float: share of ACKs that skipped the model update, raise AssertionError at the first different decision
+    """
+    if not os.path.exists(filename):
+        record_trace(filename, **kwargs)
+    reference, _ = replay_trace(filename)
+    aggregated, flows = replay_trace(filename, round_aggregate=True)
+    diff = np.nonzero((reference != aggregated).any(axis=1))[0]
+    if len(diff):
+        i = int(diff[0])
+        field = (DECISION_FIELDS + ['max_bw'])[int(np.nonzero(reference[i] != aggregated[i])[0][0])]
+        raise AssertionError(f"ack {i} {field}: per ACK {reference[i]} aggregated {aggregated[i]}")
+    quiet = sum(_.quiet_acks for _ in flows) / len(reference)
+    print(f"{len(reference)} ACKs identical, {quiet:.1%} skipped the model update")
+    return quiet
+
+if __name__ == '__main__':
+    print(f"{validate()} steps identical")
+    validate_round_aggregate()
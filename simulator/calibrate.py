@@ -0,0 +1,232 @@
+"""Calibrate the fluid model against the testbed.
+
+Every testbed experiment with a metadata.json(bulk flows of algorithms the model knows, no cross traffic) is
+simulated again with the same configuration, and the 0.1 second series of every flow are compared with the
+iperf/tcpgen sender records of analysis_send.csv:
+
+    throughput  bits_per_second
+    rtt         smoothed RTT of tcp_info, ms
+    cwnd        snd_cwnd, payload bytes
+
+The error of a series is its RMSE normalized by the measured mean(NRMSE), the error of a parameter set is
+the weighted mean over all flows and series. The calibration keys of fluid_model.CALIBRATION(host processing
+delay, ACK aggregation, queue limit, shaper efficiency) are fitted by a grid search that zooms in around the
+best point every round. Every candidate of a round is one more copy of the experiments in the same batch, so a
+round is one FluidModel run. A quarter of the experiments is held out to report the error on unseen scenarios:
+
+    python3 -m simulator.calibrate      # after analyzer/iperf_analyzer.py, writes calibration.json
+
+and calibrated(configs) applies the fitted keys to configurations before simulate.
+"""
+import os
+import csv
+import json
+import itertools
+import collections
+import numpy as np
+from simulator.fluid_model import FluidModel, CC_CODES, CALIBRATION
+
+calibration_file = "calibration.json"
+errors_file = "calibration_errors.csv"
+flows_file = "calibration_flows.csv"
+SERIES = ['throughput', 'rtt', 'cwnd']
+WEIGHTS = {'throughput': 1.0, 'rtt': 1.0, 'cwnd': 0.5}
+# first grid of the search, every round halves the step around the best value
+SEARCH_SPACE = {
+    'host_delay': [0.0, 0.0005, 0.001, 0.002],
+    'ack_aggregation': [0.0, 0.1, 0.25],
+    'buffer_pkts': [250, 500, 1000],
+    'link_efficiency': [0.95, 1.0],
+}
+HOLDOUT = 4 # every 4th experiment is held out of the fit
+
+
+def load_measured(send_file="analysis_send.csv"):
+    """analysis_send.csv -> {experiment_id: {host: {'time': mid of every record, series: np.array}}}"""
+    rows = collections.defaultdict(lambda: collections.defaultdict(list))
+    with open(send_file) as f:
+        for row in csv.DictReader(f):
+            rows[row['experiment_id']][row['host'].split("_")[0]].append(row)
+
+    def column(records, name, scale):
+        return np.array([float(_[name]) * scale if _.get(name) else np.nan for _ in records])
+
+    measured = {}
+    for experiment_id, hosts in rows.items():
+        measured[experiment_id] = {}
+        for host, records in hosts.items():
+            measured[experiment_id][host] = {
+                'time': (column(records, 'start', 1) + column(records, 'end', 1)) / 2,
+                'throughput': column(records, 'bits_per_second', 1),
+                # iperf and tcpgen report rtt in usecs
+                'rtt': column(records, 'rtt', 1e-3),
+                'cwnd': column(records, 'snd_cwnd', 1),
+            }
+    return measured
+
+def load_scenarios(logs_path="./logs", send_file="analysis_send.csv"):
+    """(experiment_id, metadata, flows measured on hs1..hsN) of every experiment the fluid model can replay"""
+    measured = load_measured(send_file)
+    scenarios = []
+    for experiment_id in sorted(measured):
+        metadata_file = os.path.join(logs_path, experiment_id, 'metadata.json')
+        if not os.path.exists(metadata_file):
+            continue
+        with open(metadata_file) as f:
+            metadata = json.load(f)
+        if not all(_ in CC_CODES for _ in metadata['cctypes']) or metadata.get('cross_traffic') \
+                or any(_.get('type', 'bulk') != 'bulk' for _ in metadata.get('workloads') or []):
+            continue
+        flows = [measured[experiment_id].get(f'hs{i}') for i in range(1, len(metadata['cctypes']) + 1)]
+        if any(_ is None for _ in flows):
+            continue
+        scenarios.append((experiment_id, metadata, flows))
+    return scenarios
+
+def series_error(measured, simulated):
+    """NRMSE and relative bias of simulated against measured, both sampled at the same times"""
+    valid = ~np.isnan(measured) & ~np.isnan(simulated) & (measured > 0)
+    if valid.sum() < 2:
+        return np.nan, np.nan
+    m, s = measured[valid], simulated[valid]
+    return float(np.sqrt(np.mean((s - m) ** 2)) / m.mean()), float((s - m).mean() / m.mean())
+
+def flow_errors(flow, start, result, c, f):
+    """errors of every series of one measured flow against flow f of configuration c of a FluidModel.run result"""
+    # measured records start at the flow start, the simulation at the experiment start
+    times = start + flow['time']
+    errors = {}
+    for series in SERIES:
+        simulated = result[series][c, f]
+        ok = ~np.isnan(simulated)
+        if ok.sum() < 2:
+            errors[series], errors[f'{series}_bias'] = np.nan, np.nan
+            continue
+        sampled = np.interp(times, result['time'][ok], simulated[ok], left=np.nan, right=np.nan)
+        errors[series], errors[f'{series}_bias'] = series_error(flow[series], sampled)
+    return errors
+
+def objective(errors):
+    """weighted mean error of one flow, series without measurements(e.g. no cwnd in the logs) are left out"""
+    values = [(WEIGHTS[_], errors[_]) for _ in SERIES if not np.isnan(errors[_])]
+    return sum(w * e for w, e in values) / sum(w for w, _ in values) if values else np.nan
+
+def evaluate(scenarios, candidates, dt=0.001, seed=0, sample_interval=0.1):
+    """simulate every scenario with every candidate parameter set in one batch
+
+    Returns:
+        list: per candidate a list of per flow dicts(experiment_id, host, cctype, errors of every series)
+    """
+    configs = [dict(metadata, **candidate) for candidate in candidates for _, metadata, _ in scenarios]
+    model = FluidModel(configs, dt=dt, seed=seed)
+    result = model.run(sample_interval)
+    evaluated = []
+    for i, _ in enumerate(candidates):
+        rows = []
+        for j, (experiment_id, metadata, flows) in enumerate(scenarios):
+            c = i * len(scenarios) + j
+            for f, flow in enumerate(flows):
+                errors = flow_errors(flow, model.start[c, f], result, c, f)
+                rows.append(dict(experiment_id=experiment_id, host=f'hs{f + 1}', cctype=metadata['cctypes'][f],
+                                 objective=objective(errors), **errors))
+        evaluated.append(rows)
+    return evaluated
+
+def mean_objective(rows):
+    values = [_['objective'] for _ in rows if not np.isnan(_['objective'])]
+    return float(np.mean(values)) if values else np.nan
+
+def refine(space, best):
+    """a grid of three values around the best one, half the step of the previous grid"""
+    refined = {}
+    for key, values in space.items():
+        values = sorted(values)
+        step = min(b - a for a, b in zip(values, values[1:])) if len(values) > 1 else 0
+        if not step:
+            refined[key] = [best[key]]
+            continue
+        refined[key] = sorted({round(max(best[key] + d * step / 2, 0), 6) for d in (-1, 0, 1)})
+        if key == 'buffer_pkts':
+            refined[key] = sorted({int(round(_)) for _ in refined[key]})
+    return refined
+
+def fit(scenarios, space=SEARCH_SPACE, rounds=3, **kwargs):
+    """grid search the calibration keys minimizing the mean objective over all flows of scenarios
+
+    Returns:
+        (dict, list): best parameters, (parameters, mean objective) of every evaluated candidate
+    """
+    history = []
+    best = None
+    for round_ in range(rounds):
+        keys = list(space)
+        candidates = [dict(zip(keys, values)) for values in itertools.product(*space.values())]
+        seen = [_[0] for _ in history]
+        candidates = [_ for _ in candidates if _ not in seen]
+        if not candidates:
+            break
+        for candidate, rows in zip(candidates, evaluate(scenarios, candidates, **kwargs)):
+            history.append((candidate, mean_objective(rows)))
+        best, error = min([_ for _ in history if not np.isnan(_[1])], key=lambda _: _[1])
+        print(f"round {round_ + 1}: {len(candidates)} candidates, best error {error:.3f} {best}")
+        space = refine(space, best)
+    return best, history
+
+def summarize(rows):
+    """mean NRMSE of every series and the objective over flows"""
+    return {series: float(np.nanmean([_[series] for _ in rows])) if rows else np.nan
+            for series in SERIES + ['objective']}
+
+def calibrate(logs_path="./logs", send_file="analysis_send.csv", rounds=3, **kwargs):
+    """fit the calibration keys on the testbed experiments and check them on held out ones, writes
+    calibration.json(parameters and errors), calibration_errors.csv(every candidate) and
+    calibration_flows.csv(per flow errors before and after)
+
+    Returns:
+        dict: the content of calibration.json
+    """
+    scenarios = load_scenarios(logs_path, send_file)
+    if not scenarios:
+        print("no experiment to calibrate against, run some with metadata.json and analyzer/iperf_analyzer.py")
+        return {}
+    train = [_ for i, _ in enumerate(scenarios) if i % HOLDOUT != HOLDOUT - 1 or len(scenarios) < HOLDOUT]
+    test = [_ for _ in scenarios if _ not in train]
+    best, history = fit(train, rounds=rounds, **kwargs)
+
+    default = {k: CALIBRATION[k] for k in best}
+    before, after = evaluate(scenarios, [default, best], **kwargs)
+    test_ids = {_[0] for _ in test}
+    split = lambda rows, held_out: [_ for _ in rows if (_['experiment_id'] in test_ids) == held_out]
+    calibration = {
+        'parameters': best,
+        'experiments': len(scenarios), 'held_out': len(test),
+        'train': {'default': summarize(split(before, False)), 'calibrated': summarize(split(after, False))},
+        'test': {'default': summarize(split(before, True)), 'calibrated': summarize(split(after, True))},
+    }
+    with open(calibration_file, 'w') as f:
+        json.dump(calibration, f, indent=4)
+    with open(errors_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=list(best) + ['error'])
+        writer.writeheader()
+        writer.writerows([dict(candidate, error=error) for candidate, error in history])
+    with open(flows_file, 'w') as f:
+        fieldnames = ['experiment_id', 'host', 'cctype', 'calibrated', 'objective'] + \
+                     [f'{_}{suffix}' for _ in SERIES for suffix in ('', '_bias')]
+        writer = csv.DictWriter(f, fieldnames=fieldnames)
+        writer.writeheader()
+        writer.writerows([dict(_, calibrated=False) for _ in before] + [dict(_, calibrated=True) for _ in after])
+
+    for part in ['train', 'test']:
+        for name in ['default', 'calibrated']:
+            errors = calibration[part][name]
+            print(f"{part:>5} {name:>10}: " + " ".join(f"{k} {v:.1%}" for k, v in errors.items()))
+    return calibration
+
+def calibrated(configs, filename=calibration_file):
+    """configurations with the fitted calibration keys, keys already set in a configuration are kept"""
+    with open(filename) as f:
+        parameters = json.load(f)['parameters']
+    return [dict(parameters, **config) for config in configs]
+
+if __name__ == '__main__':
+    calibrate()
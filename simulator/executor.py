@@ -0,0 +1,334 @@
+"""Parallel sweep executor for simulation and replay jobs.
+
+Sweeps mix very short jobs(one STARTUP, a single flow) with long ones(60 seconds of many flows), so splitting
+the job list evenly over the cores up front leaves most of them idle while the slowest share finishes. Here
+every worker holds one job at a time and gets the next one from the shared queue as soon as it is idle, the
+queue hands out the highest priority first and, at the same priority, the most expensive first so the long jobs
+don't end up alone at the tail:
+
+    executor = Executor(sink=SqliteSink('fluid_sweep'))
+    for chunk in chunks(configs, 16):
+        executor.submit(fluid_job, chunk, cost=fluid_cost(chunk))
+    for job in executor.as_completed():
+        if job.error:
+            print(job.error)
+
+as_completed yields every job when it finishes and the sink writes its rows into the analysis store
+(analysis.db, refer to analyzer/query.py) right away, so a sweep can be queried while it runs. Pending jobs can
+be cancelled or reprioritized at any time, also from inside the as_completed loop, cancelling a running job
+stops its worker and starts a fresh one.
+
+A job is a picklable callable with its arguments. fluid_job, dumbbell_job and replay_job run the fluid model,
+the packet level Dumbbell and a golden trace replay(bbr_engine.replay_trace) and return rows for the store,
+snapshot.fork runs its variants through the same executor.
+"""
+import sys
+import json
+import time
+import heapq
+import sqlite3
+import itertools
+import traceback
+import multiprocessing
+from multiprocessing import connection
+
+PENDING, RUNNING, DONE, FAILED, CANCELLED = 'pending', 'running', 'done', 'failed', 'cancelled'
+database_file = "analysis.db"
+
+
+class Job():
+    def __init__(self, job_id, fn, args, kwargs, priority, cost, key):
+        self.id = job_id
+        self.fn = fn
+        self.args = args
+        self.kwargs = kwargs
+        self.priority = priority
+        self.cost = cost
+        self.key = key or {}
+        self.state = PENDING
+        self.result = None
+        self.error = None
+        self.seconds = None
+        self.worker = None
+
+    def __repr__(self):
+        return f"Job({self.id}, {getattr(self.fn, '__name__', self.fn)}, {self.state})"
+
+
+def worker_main(conn):
+    """run the jobs sent over conn one by one until None, send back (job id, result, error, seconds)"""
+    while True:
+        task = conn.recv()
+        if task is None:
+            return
+        job_id, fn, args, kwargs = task
+        start = time.perf_counter()
+        try:
+            result, error = fn(*args, **kwargs), None
+        except Exception:
+            result, error = None, traceback.format_exc()
+        try:
+            conn.send((job_id, result, error, time.perf_counter() - start))
+        except Exception:
+            # the result can't be pickled
+            conn.send((job_id, None, traceback.format_exc(), time.perf_counter() - start))
+
+
+class Worker():
+    def __init__(self, context):
+        self.conn, child = context.Pipe()
+        self.process = context.Process(target=worker_main, args=(child,), daemon=True)
+        self.process.start()
+        child.close()
+        self.job = None
+
+    def stop(self, kill=False):
+        if kill:
+            self.process.terminate()
+        else:
+            try:
+                self.conn.send(None)
+            except (OSError, ValueError):
+                pass
+        self.process.join()
+        self.conn.close()
+
+
+class Executor():
+    def __init__(self, processes=None, sink=None):
+        """
+        Args:
+            processes (int, optional): worker processes. Defaults to the cpu count.
+            sink (callable, optional): called with every finished job before as_completed yields it, e.g.
+                SqliteSink. Defaults to None.
+        """
+        self.processes = processes or multiprocessing.cpu_count()
+        self.sink = sink
+        # fork keeps the workers cheap to start and sees the modules already imported
+        self.context = multiprocessing.get_context('fork')
+        self.jobs = {}
+        self.queue = []
+        self.workers = []
+        self.ids = itertools.count()
+        self.order = itertools.count()
+        self.finished = []
+
+    def submit(self, fn, *args, priority=0, cost=1, key=None, **kwargs):
+        """queue fn(*args, **kwargs)
+
+        Args:
+            priority (int, optional): higher runs first. Defaults to 0.
+            cost (float, optional): estimated run time in any unit, at the same priority more expensive jobs run
+                first. Defaults to 1.
+            key (dict, optional): parameters of the job, added to every row the sink stores. Defaults to None.
+        Returns:
+            Job: the queued job
+        """
+        job = Job(next(self.ids), fn, args, kwargs, priority, cost, key)
+        self.jobs[job.id] = job
+        self.push(job)
+        return job
+
+    def push(self, job):
+        heapq.heappush(self.queue, (-job.priority, -job.cost, next(self.order), job.id, job.priority))
+
+    def reprioritize(self, job, priority):
+        """change the priority of a pending job"""
+        job = self.jobs[getattr(job, 'id', job)]
+        if job.state == PENDING:
+            # the old queue entry is skipped when its priority no longer matches
+            job.priority = priority
+            self.push(job)
+
+    def cancel(self, job):
+        """drop a pending job or stop a running one, returns False if it already finished"""
+        job = self.jobs[getattr(job, 'id', job)]
+        if job.state == RUNNING:
+            worker = next(_ for _ in self.workers if _.job is job)
+            worker.stop(kill=True)
+            self.workers.remove(worker)
+            self.workers.append(Worker(self.context))
+        elif job.state != PENDING:
+            return False
+        job.state = CANCELLED
+        return True
+
+    def cancel_all(self):
+        for job in list(self.jobs.values()):
+            if job.state in (PENDING, RUNNING):
+                self.cancel(job)
+
+    def pop(self):
+        while self.queue:
+            _, _, _, job_id, priority = heapq.heappop(self.queue)
+            job = self.jobs[job_id]
+            if job.state == PENDING and job.priority == priority:
+                return job
+        return None
+
+    def dispatch(self):
+        for worker in self.workers:
+            if worker.job is not None:
+                continue
+            job = self.pop()
+            if job is None:
+                return
+            try:
+                worker.conn.send((job.id, job.fn, job.args, job.kwargs))
+            except Exception:
+                # the job itself can't be pickled
+                self.finish(job, None, traceback.format_exc(), 0)
+                continue
+            job.state, job.worker = RUNNING, worker.process.pid
+            worker.job = job
+
+    def finish(self, job, result, error, seconds):
+        job.result, job.error, job.seconds = result, error, seconds
+        job.state = FAILED if error else DONE
+        if self.sink and not error:
+            try:
+                self.sink(job)
+            except Exception:
+                job.error, job.state = traceback.format_exc(), FAILED
+        self.finished.append(job)
+
+    def as_completed(self):
+        """run the queued jobs(and the ones submitted meanwhile), yield every job when it is done or failed,
+        cancelled jobs are not yielded
+        """
+        while len(self.workers) < self.processes:
+            self.workers.append(Worker(self.context))
+        try:
+            while True:
+                self.dispatch()
+                while self.finished:
+                    yield self.finished.pop(0)
+                    self.dispatch()
+                busy = [_ for _ in self.workers if _.job is not None]
+                if not busy:
+                    if not self.finished:
+                        return
+                    continue
+                waits = {_.conn: _ for _ in busy}
+                waits.update({_.process.sentinel: _ for _ in busy})
+                for ready in connection.wait(list(waits)):
+                    worker = waits[ready]
+                    job = worker.job
+                    if job is None:
+                        continue
+                    try:
+                        job_id, result, error, seconds = worker.conn.recv()
+                    except (EOFError, OSError):
+                        # the worker died with the job, e.g. killed for memory
+                        self.workers.remove(worker)
+                        self.workers.append(Worker(self.context))
+                        result, error, seconds = None, f"worker exited with {worker.process.exitcode}", None
+                    worker.job = None
+                    self.finish(job, result, error, seconds)
+        finally:
+            self.close(kill=any(_.job is not None for _ in self.workers))
+
+    def run(self):
+        """run every queued job, returns the jobs in submit order"""
+        for _ in self.as_completed():
+            pass
+        return sorted(self.jobs.values(), key=lambda _: _.id)
+
+    def close(self, kill=False):
+        for worker in self.workers:
+            worker.stop(kill=kill)
+        self.workers = []
+
+
+def sqlite_value(value):
+    """numpy scalars to python ones, containers to json"""
+    if hasattr(value, 'item') and getattr(value, 'ndim', 0) == 0:
+        return value.item()
+    if isinstance(value, (list, tuple, dict)) or hasattr(value, 'tolist'):
+        return json.dumps(value.tolist() if hasattr(value, 'tolist') else value, default=str)
+    return value
+
+
+def quote(name):
+    """a sqlite identifier, so keys like order or group work as column names"""
+    return '"' + str(name).replace('"', '""') + '"'
+
+
+class SqliteSink():
+    """append the rows a job returned(a dict or a list of dicts) with its key, id and run time to a table of the
+    analysis store, committed per job. Missing columns are added as new keys show up.
+    """
+    def __init__(self, table, filename=database_file):
+        self.table = quote(table)
+        self.db = sqlite3.connect(filename)
+        self.columns = [_[1] for _ in self.db.execute(f"PRAGMA table_info({self.table})")]
+
+    def __call__(self, job):
+        rows = job.result if isinstance(job.result, list) else [job.result]
+        rows = [dict(job.key, job_id=job.id, job_seconds=job.seconds, **row) for row in rows if row is not None]
+        for row in rows:
+            for column in row:
+                if column not in self.columns:
+                    if self.columns:
+                        self.db.execute(f"ALTER TABLE {self.table} ADD COLUMN {quote(column)}")
+                    else:
+                        self.db.execute(f"CREATE TABLE {self.table} ({quote(column)})")
+                    self.columns.append(column)
+            self.db.execute(f"INSERT INTO {self.table} ({', '.join(map(quote, row))}) VALUES ({', '.join('?' * len(row))})",
+                            [sqlite_value(_) for _ in row.values()])
+        self.db.commit()
+
+
+def chunks(items, size):
+    return [items[i:i + size] for i in range(0, len(items), size)]
+
+def fluid_cost(configs):
+    """simulated flow seconds of a batch of fluid model configurations"""
+    return sum(len(_['cctypes']) * (_['duration'] + len(_['cctypes']) * _.get('start_delay', 0)) for _ in configs)
+
+def fluid_job(configs, **kwargs):
+    """simulate a batch of configurations in one FluidModel, one row per configuration"""
+    from simulator.fluid_model import simulate
+    _, summary = simulate(configs, **kwargs)
+    return [dict(row.pop('config'), **row) for row in summary]
+
+def dumbbell_job(rtt_us, bw_mbps=100, duration_s=10, seed=0, **kwargs):
+    """run the packet level Dumbbell, one row per flow with its mean goodput(Mbps)"""
+    from simulator.bbr_engine import Dumbbell
+    goodput = Dumbbell(rtt_us, bw_mbps=bw_mbps, seed=seed, **kwargs).run(duration_s)
+    return [{'flow': i, 'rtt_us': int(rtt), 'goodput': float(goodput[:, i].mean())} for i, rtt in enumerate(rtt_us)]
+
+def replay_job(filename, round_aggregate=False, params=None):
+    """replay a golden trace through BbrFlow with module constants of bbr_engine overridden by params, one row
+    with the share of ACKs per bbr mode and the final max bw of every flow. The overrides are undone afterwards
+    since the worker runs other jobs next.
+    """
+    from simulator import bbr_engine
+    params = params or {}
+    saved = {name: getattr(bbr_engine, name) for name in params}
+    try:
+        for name, value in params.items():
+            setattr(bbr_engine, name, value)
+        decisions, flows = bbr_engine.replay_trace(filename, round_aggregate=round_aggregate)
+    finally:
+        for name, value in saved.items():
+            setattr(bbr_engine, name, value)
+    modes = decisions[:, bbr_engine.DECISION_FIELDS.index('mode')]
+    row = {'trace': filename, 'round_aggregate': round_aggregate, 'params': params, 'acks': len(decisions),
+           'quiet_acks': sum(_.quiet_acks for _ in flows) / max(len(decisions), 1),
+           'max_bw': [int(_.max_bw()) for _ in flows]}
+    row.update({f'mode_{mode}': float((modes == mode).mean()) for mode in range(4)})
+    return row
+
+if __name__ == '__main__':
+    from simulator.fluid_model import grid_configs
+    # a sweep of very uneven jobs: single flows for 5 seconds up to 8 flows for 60 seconds
+    configs = grid_configs(cctypes=[['bbr'], ['bbr2', 'cubic'], ['bbr'] * 8], bw=[10, 100], delay=['10ms', '100ms'],
+                           loss=[0, 1], duration=[5, 60])
+    executor = Executor(sink=SqliteSink('fluid_sweep'))
+    for chunk in chunks(configs, 4):
+        executor.submit(fluid_job, chunk, cost=fluid_cost(chunk))
+    start = time.perf_counter()
+    for job in executor.as_completed():
+        print(f"job {job.id} ({job.cost} flow seconds) {job.state} in {job.seconds:.1f}s", file=sys.stderr)
+    print(f"{len(configs)} configurations in {time.perf_counter() - start:.1f}s")
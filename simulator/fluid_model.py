@@ -0,0 +1,533 @@
+"""Fluid model of the dumbbell testbed: every flow is a rate, the s1-s2 bottleneck is one FIFO queue.
+
+All configurations are simulated together, the state of every flow is an array of shape
+(configs, flows), so one numpy operation advances thousands of experiments at once.
+A configuration uses the same keys as the metadata.json written by CCTest, e.g.
+    {'cctypes': ['bbr', 'cubic'], 'bw': 10, 'delay': '20ms', 'delays': None, 'loss': 0,
+     'duration': 30, 'start_delay': 0}
+plus optional calibration keys(CALIBRATION) fitted against the testbed by simulator/calibrate.py.
+
+Two passes: prune steps every configuration once per RTT(PRUNE_STEPS_PER_RTT) to rank a whole sweep, simulate
+steps every millisecond and is what validate compares with the testbed. On one core with 4000 configurations
+of 10 seconds(a grid of 1-2 flows of bbr, bbr2, cubic and reno, 10-100Mbps, 10-100ms, 0-1% loss), prune runs
+about 3000 configurations per second(about 1300 for 30 seconds) against about 90 for simulate, with a mean
+error against simulate of 4.5% per flow throughput, 8% RTT and 1% jain fairness(prune_error). The error
+against the testbed adds up with the one validate reports for simulate, so re-simulate the configurations
+prune picked before comparing them in detail.
+"""
+import os
+import csv
+import json
+import itertools
+import collections
+import numpy as np
+
+MSS = 1448 # iperf payload per packet
+PACKET = 1514 # bytes on the wire per packet
+BUFFER_PKTS = 1000 # netem default limit of mininet TCLink
+BOTTLENECK_DELAY = 0.001 # s1-s2 link delay
+
+# cc types
+BBR, BBR2, CUBIC, RENO = 0, 1, 2, 3
+# ECN marking is not modeled, bbr2_ecn behaves like bbr2 on a tail drop queue
+CC_CODES = {'bbr': BBR, 'bbrplus': BBR, 'bbr2': BBR2, 'bbr2_ecn': BBR2, 'cubic': CUBIC, 'reno': RENO}
+# bbr modes
+STARTUP, DRAIN, PROBE_BW, PROBE_RTT = 0, 1, 2, 3
+# bbr2 ProbeBW phases, cycle_idx of bbr v1 uses the 8 phases of BBR_GAINS
+UP, DOWN, CRUISE, REFILL = 0, 1, 2, 3
+
+HIGH_GAIN = 2.885
+BBR_GAINS = np.array([1.25, 0.75, 1, 1, 1, 1, 1, 1])
+BBR2_GAINS = np.array([1.25, 0.75, 1, 1])
+BW_FILTER_ROUNDS = 10
+MIN_RTT_WIN = 10.0
+BBR2_PROBE_RTT_WIN = 5.0
+PROBE_RTT_TIME = 0.2
+BBR2_BETA = 0.3
+BBR2_LOSS_THRESH = 0.02
+BBR2_HEADROOM = 0.15
+BBR2_PROBE_BASE = 2.0
+BBR2_PROBE_RAND = 1.0
+BBR2_PROBE_MAX_ROUNDS = 63
+# time steps per RTT of the coarse pruning pass, refer to prune
+PRUNE_STEPS_PER_RTT = 1
+CUBIC_BETA = 0.7
+CUBIC_C = 0.4
+# calibration keys of a configuration and their defaults:
+#   host_delay       seconds of end host processing(softirq, veth, ACK generation) added to every RTT
+#   ack_aggregation  relative overestimate of the bbr delivery rate samples by ACKs arriving in bursts
+#   buffer_pkts      bottleneck queue limit in packets
+#   link_efficiency  share of the configured bottleneck rate the htb/netem shaper really delivers
+CALIBRATION = {'host_delay': 0.0, 'ack_aggregation': 0.0, 'buffer_pkts': BUFFER_PKTS, 'link_efficiency': 1.0}
+
+
+def parse_delay(delay):
+    """'10ms' -> 0.01"""
+    return float(delay[:-2]) / 1000
+
+def build_configs(configs, buffer_pkts=BUFFER_PKTS):
+    """turn a list of configuration dicts into padded arrays
+
+    Returns:
+        dict: cc (C, F) cc codes with -1 for missing flows, prop_rtt (C, F) seconds, start and end (C, F) seconds,
+            capacity (C,) bytes per second, loss (C,) drop probability, buffer (C,) bytes,
+            ack_aggregation (C,) relative
+    """
+    n_flows = max(len(_['cctypes']) for _ in configs)
+    shape = (len(configs), n_flows)
+    arrays = {
+        'cc': np.full(shape, -1, dtype=np.int8),
+        'prop_rtt': np.ones(shape),
+        'start': np.zeros(shape),
+        'end': np.zeros(shape),
+        'capacity': np.zeros(len(configs)),
+        'loss': np.zeros(len(configs)),
+        'buffer': np.full(len(configs), float(buffer_pkts * PACKET)),
+        'ack_aggregation': np.zeros(len(configs)),
+    }
+    for c, config in enumerate(configs):
+        n = len(config['cctypes'])
+        delays = config.get('delays') or [config['delay']] * n
+        start_delay = config.get('start_delay', 0)
+        for f, (cctype, delay) in enumerate(zip(config['cctypes'], delays)):
+            arrays['cc'][c, f] = CC_CODES[cctype]
+            # half of the delay on each access link, refer to MyTopo.build
+            arrays['prop_rtt'][c, f] = 2 * (parse_delay(delay) + BOTTLENECK_DELAY) + config.get('host_delay', 0)
+            arrays['start'][c, f] = f * start_delay
+            arrays['end'][c, f] = f * start_delay + config['duration']
+        arrays['capacity'][c] = config['bw'] * 1e6 / 8 * config.get('link_efficiency', 1)
+        arrays['loss'][c] = config.get('loss', 0) / 100
+        arrays['buffer'][c] = config.get('buffer_pkts', buffer_pkts) * PACKET
+        arrays['ack_aggregation'][c] = config.get('ack_aggregation', 0)
+    return arrays
+
+class FluidModel():
+    def __init__(self, configs, dt=0.001, buffer_pkts=BUFFER_PKTS, seed=0):
+        """
+        Args:
+            configs (list): configuration dicts, refer to the module doc
+            dt (float, optional): time step in seconds, keep it below the smallest RTT. Defaults to 0.001.
+            buffer_pkts (int, optional): bottleneck queue limit in packets of configurations without buffer_pkts.
+                Defaults to BUFFER_PKTS.
+            seed (int, optional): seed of the random ProbeBW start phase and bbr2 probe wait. Defaults to 0.
+        """
+        self.configs = configs
+        self.dt = dt
+        self.rng = np.random.default_rng(seed)
+        self.__dict__.update(build_configs(configs, buffer_pkts))
+        shape = self.cc.shape
+        self.now = 0.0
+        self.queue = np.zeros(shape[0])
+        self.is_bbr = (self.cc == BBR) | (self.cc == BBR2)
+        self.is_bbr2 = self.cc == BBR2
+        self.is_aimd = (self.cc == CUBIC) | (self.cc == RENO)
+        self.is_cubic = self.cc == CUBIC
+        self.aimd_beta = np.where(self.is_cubic, CUBIC_BETA, 0.5)
+        self.min_rtt_win = np.where(self.is_bbr2, BBR2_PROBE_RTT_WIN, MIN_RTT_WIN)
+        self.any_bbr, self.any_aimd = self.is_bbr.any(), self.is_aimd.any()
+        self.started = np.zeros(shape, dtype=bool)
+
+        # bbr state, names follow struct bbr in tcp_bbr.c and bbr2.c
+        self.mode = np.full(shape, STARTUP, dtype=np.int8)
+        self.bw_slots = np.zeros(shape + (BW_FILTER_ROUNDS,))
+        self.slot = np.zeros(shape, dtype=np.int64)
+        self.bw = np.zeros(shape)
+        self.round_max = np.zeros(shape)
+        self.round_elapsed = np.zeros(shape)
+        self.round_lost = np.zeros(shape)
+        self.round_sent = np.zeros(shape)
+        self.min_rtt = np.full(shape, np.inf)
+        self.min_rtt_stamp = np.zeros(shape)
+        self.full_bw = np.zeros(shape)
+        self.full_bw_cnt = np.zeros(shape, dtype=np.int8)
+        self.full_bw_reached = np.zeros(shape, dtype=bool)
+        self.cycle_idx = np.zeros(shape, dtype=np.int8)
+        self.cycle_elapsed = np.zeros(shape)
+        self.probe_rtt_done = np.zeros(shape)
+        self.inflight_hi = np.full(shape, np.inf)
+        self.bw_lo = np.full(shape, np.inf)
+        self.probe_up_cnt = np.ones(shape)
+        self.probe_wait = np.zeros(shape)
+        self.rounds_since_probe = np.zeros(shape)
+
+        # cubic/reno state, window in bytes
+        self.cwnd = np.zeros(shape)
+        self.w_max = np.zeros(shape)
+        self.cubic_k = np.zeros(shape)
+        self.epoch = np.zeros(shape)
+        self.lost_acc = np.zeros(shape)
+        self.since_cut = np.zeros(shape)
+
+        self.rate = np.zeros(shape)
+        self.window = np.zeros(shape)
+        self.delivery = np.zeros(shape)
+        self.rtt = self.prop_rtt.copy()
+
+    def active(self):
+        return (self.cc >= 0) & (self.now >= self.start) & (self.now < self.end)
+
+    def start_flows(self, active):
+        new = active & ~self.started
+        if not new.any():
+            return
+        self.started |= new
+        # initial window of 10 packets, like the kernel
+        self.bw[new] = (10 * PACKET / self.prop_rtt)[new]
+        self.cwnd[new] = 10 * PACKET
+        self.min_rtt_stamp[new] = self.now
+
+    def send_rate(self, active):
+        """pacing rate limited by cwnd(and bbr2 inflight bounds) over the current RTT"""
+        # kept for update_bbr, bw and min_rtt don't change in between
+        self.bdp = bdp = self.bw * np.where(np.isinf(self.min_rtt), self.prop_rtt, self.min_rtt)
+        gain = np.select(
+            [self.mode == STARTUP, self.mode == DRAIN, self.mode == PROBE_RTT, self.is_bbr2],
+            [HIGH_GAIN, 1 / HIGH_GAIN, 1.0, BBR2_GAINS[np.minimum(self.cycle_idx, 3)]],
+            BBR_GAINS[self.cycle_idx])
+        cwnd_gain = np.where(self.mode == STARTUP, HIGH_GAIN, 2.0)
+        cwnd = np.maximum(cwnd_gain * bdp, 4 * PACKET)
+        # ProbeRTT keeps 4 packets(bbr) or half the bdp(bbr2) in flight
+        cwnd = np.where(self.mode == PROBE_RTT, np.where(self.is_bbr2, np.maximum(bdp / 2, 4 * PACKET), 4 * PACKET), cwnd)
+        # bbr2 leaves headroom under inflight_hi when not probing
+        headroom = np.where((self.mode == PROBE_BW) & (self.cycle_idx >= DOWN) & (self.cycle_idx <= CRUISE),
+                            1 - BBR2_HEADROOM, 1.0)
+        cwnd = np.where(self.is_bbr2, np.minimum(cwnd, np.maximum(self.inflight_hi * headroom, 4 * PACKET)), cwnd)
+        bw = np.where(self.is_bbr2, np.minimum(self.bw, self.bw_lo), self.bw)
+        bbr_rate = np.minimum(gain * bw, cwnd / self.rtt)
+        self.window = np.where(self.is_bbr, cwnd, self.cwnd)
+        rate = np.where(self.is_bbr, bbr_rate, self.cwnd / self.rtt)
+        return np.where(active, rate, 0)
+
+    def step(self):
+        dt = self.dt
+        active = self.active()
+        self.start_flows(active)
+        self.rate = self.send_rate(active)
+
+        # bottleneck queue
+        arrival = self.rate * (1 - self.loss[:, None])
+        total = arrival.sum(axis=1)
+        queue = self.queue + (total - self.capacity) * dt
+        overflow = np.maximum(queue - self.buffer, 0)
+        drop = np.where(total > 0, overflow / np.maximum(total * dt, 1e-9), 0)
+        self.queue = np.clip(queue, 0, self.buffer)
+        inflow = arrival * (1 - drop[:, None])
+        inflow_total = inflow.sum(axis=1)
+        service = np.where((self.queue > 0) | (inflow_total > self.capacity), self.capacity, inflow_total)
+        self.delivery = np.where(inflow_total[:, None] > 0, inflow / np.maximum(inflow_total, 1e-9)[:, None] * service[:, None], 0)
+        loss_rate = 1 - (1 - self.loss[:, None]) * (1 - drop[:, None])
+        self.rtt = self.prop_rtt + (self.queue / self.capacity)[:, None]
+
+        if self.any_bbr:
+            self.update_bbr(active & self.is_bbr, loss_rate)
+        if self.any_aimd:
+            self.update_aimd(active & self.is_aimd, loss_rate)
+        self.now += dt
+
+    def update_bbr(self, active, loss_rate):
+        elapsed = active * self.dt
+        sample = self.delivery * (1 + self.ack_aggregation[:, None])
+        self.round_max = np.where(active, np.maximum(self.round_max, sample), self.round_max)
+        sent = self.rate * elapsed
+        self.round_sent += sent
+        self.round_lost += sent * loss_rate
+        self.round_elapsed += elapsed
+        self.cycle_elapsed += elapsed
+        inflight = self.rate * self.rtt
+        bdp = self.bdp
+
+        # min_rtt filter, an expired filter takes the new sample and starts ProbeRTT
+        expired = active & (self.now - self.min_rtt_stamp > self.min_rtt_win)
+        update = active & ((self.rtt <= self.min_rtt) | expired)
+        self.min_rtt = np.where(update, self.rtt, self.min_rtt)
+        self.min_rtt_stamp = np.where(update, self.now, self.min_rtt_stamp)
+        enter_probe_rtt = expired & (self.mode != PROBE_RTT)
+        self.mode[enter_probe_rtt] = PROBE_RTT
+        self.probe_rtt_done[enter_probe_rtt] = self.now + PROBE_RTT_TIME + self.rtt[enter_probe_rtt]
+
+        # round trips: bw filter, startup full bw check, bbr2 lower bounds
+        round_end = active & (self.round_elapsed >= self.rtt)
+        if round_end.any():
+            c, f = np.nonzero(round_end)
+            self.slot[round_end] = (self.slot[round_end] + 1) % BW_FILTER_ROUNDS
+            self.bw_slots[c, f, self.slot[round_end]] = self.round_max[round_end]
+            self.bw[round_end] = self.bw_slots[c, f].max(axis=1)
+            round_loss = np.where(self.round_sent > 0, self.round_lost / np.maximum(self.round_sent, 1e-9), 0)
+            too_high = round_end & self.is_bbr2 & (round_loss > BBR2_LOSS_THRESH)
+
+            grew = self.bw >= self.full_bw * 1.25
+            startup = round_end & (self.mode == STARTUP)
+            self.full_bw = np.where(startup & grew, self.bw, self.full_bw)
+            self.full_bw_cnt = np.where(startup, np.where(grew, 0, self.full_bw_cnt + 1), self.full_bw_cnt).astype(np.int8)
+            exit_startup = startup & ((self.full_bw_cnt >= 3) | too_high)
+            self.mode[exit_startup] = DRAIN
+            self.full_bw_reached |= exit_startup
+
+            # bbr2 backs off bw_lo on any loss when not probing, cut inflight_hi when probing
+            lossy = round_end & self.is_bbr2 & (self.round_lost > 0) & (self.mode == PROBE_BW) & (self.cycle_idx != UP)
+            self.bw_lo = np.where(lossy, np.maximum(self.round_max, (1 - BBR2_BETA) * np.minimum(self.bw_lo, self.bw)), self.bw_lo)
+            cut = too_high & (((self.mode == PROBE_BW) & (self.cycle_idx == UP)) | exit_startup)
+            self.inflight_hi = np.where(cut, np.maximum(inflight, (1 - BBR2_BETA) * bdp), self.inflight_hi)
+            self.cycle_idx[cut & (self.mode == PROBE_BW)] = DOWN
+            self.cycle_elapsed[cut] = 0
+            # raise inflight_hi with an exponential slope while probing up without loss
+            raise_hi = round_end & self.is_bbr2 & (self.mode == PROBE_BW) & (self.cycle_idx == UP) & ~too_high \
+                & (inflight >= self.inflight_hi * 0.95)
+            self.inflight_hi = np.where(raise_hi, self.inflight_hi + self.probe_up_cnt * PACKET, self.inflight_hi)
+            self.probe_up_cnt = np.where(raise_hi, self.probe_up_cnt * 2, self.probe_up_cnt)
+            self.rounds_since_probe += round_end
+
+            self.round_max[round_end] = 0
+            self.round_elapsed[round_end] = 0
+            self.round_sent[round_end] = 0
+            self.round_lost[round_end] = 0
+
+        # drain the startup queue, then pick a ProbeBW phase
+        exit_drain = active & (self.mode == DRAIN) & (inflight <= bdp)
+        if exit_drain.any():
+            self.mode[exit_drain] = PROBE_BW
+            # bbr v1 starts at a random phase other than the 0.75 one, bbr2 cruises after drain
+            phase = (len(BBR_GAINS) - self.rng.integers(0, len(BBR_GAINS) - 1, size=self.cc.shape)) % len(BBR_GAINS)
+            self.cycle_idx = np.where(exit_drain, np.where(self.is_bbr2, CRUISE, phase), self.cycle_idx).astype(np.int8)
+            self.start_probe_wait(exit_drain & self.is_bbr2)
+            self.cycle_elapsed[exit_drain] = 0
+
+        # ProbeRTT ends after 200ms and one round, min_rtt_stamp restarts the window
+        exit_probe_rtt = active & (self.mode == PROBE_RTT) & (self.now >= self.probe_rtt_done)
+        if exit_probe_rtt.any():
+            self.min_rtt_stamp[exit_probe_rtt] = self.now
+            self.mode[exit_probe_rtt] = np.where(self.full_bw_reached, PROBE_BW, STARTUP)[exit_probe_rtt]
+            self.cycle_elapsed[exit_probe_rtt] = 0
+
+        probe_bw = active & (self.mode == PROBE_BW)
+        self.advance_bbr_cycle(probe_bw & ~self.is_bbr2, inflight, bdp)
+        self.advance_bbr2_cycle(probe_bw & self.is_bbr2, inflight, bdp)
+
+    def advance_bbr_cycle(self, probe_bw, inflight, bdp):
+        """bbr v1: one min_rtt per phase, 1.25 waits for inflight to reach 1.25 * bdp, 0.75 may end at bdp"""
+        elapsed = self.cycle_elapsed > self.min_rtt
+        gain = BBR_GAINS[self.cycle_idx]
+        advance = np.where(gain > 1, elapsed & (inflight >= gain * bdp),
+                           np.where(gain < 1, elapsed | (inflight <= bdp), elapsed))
+        advance &= probe_bw
+        self.cycle_idx = np.where(advance, (self.cycle_idx + 1) % len(BBR_GAINS), self.cycle_idx).astype(np.int8)
+        self.cycle_elapsed[advance] = 0
+
+    def start_probe_wait(self, mask):
+        self.probe_wait[mask] = BBR2_PROBE_BASE + self.rng.random(mask.sum()) * BBR2_PROBE_RAND
+        self.rounds_since_probe[mask] = 0
+
+    def advance_bbr2_cycle(self, probe_bw, inflight, bdp):
+        """bbr2: UP until inflight reaches 1.25 * bdp, DOWN until under bdp and inflight_hi headroom,
+        CRUISE for 2-3 seconds(or min(bdp, 63) rounds), REFILL one round
+        """
+        idx = self.cycle_idx
+        elapsed = self.cycle_elapsed > self.min_rtt
+        to_down = probe_bw & (idx == UP) & elapsed & (inflight >= 1.25 * bdp)
+        to_cruise = probe_bw & (idx == DOWN) & (inflight <= np.minimum(bdp, (1 - BBR2_HEADROOM) * self.inflight_hi))
+        reno_rounds = np.minimum(bdp / PACKET, BBR2_PROBE_MAX_ROUNDS)
+        to_refill = probe_bw & ((idx == CRUISE) | (idx == DOWN)) \
+            & ((self.cycle_elapsed >= self.probe_wait) | (self.rounds_since_probe >= reno_rounds))
+        to_up = probe_bw & (idx == REFILL) & (self.cycle_elapsed >= self.rtt)
+
+        self.cycle_idx[to_down] = DOWN
+        self.cycle_idx[to_cruise] = CRUISE
+        self.cycle_idx[to_refill] = REFILL
+        self.cycle_idx[to_up] = UP
+        # refill resets the lower bounds, probing up restarts the inflight_hi slope
+        self.bw_lo[to_refill] = np.inf
+        self.probe_up_cnt[to_up] = 1
+        self.start_probe_wait(to_down)
+        changed = to_down | to_refill | to_up
+        self.cycle_elapsed[changed] = 0
+
+    def update_aimd(self, active, loss_rate):
+        """cubic and reno window, at most one reduction per RTT once a whole packet is lost"""
+        dt = self.dt
+        elapsed = active * dt
+        self.since_cut += elapsed
+        self.epoch += elapsed
+        self.lost_acc += self.rate * loss_rate * elapsed / PACKET
+        cut = active & (self.lost_acc >= 1) & (self.since_cut >= self.rtt)
+        self.w_max = np.where(cut, self.cwnd, self.w_max)
+        # K of the cubic curve only changes with w_max
+        self.cubic_k = np.where(cut, np.cbrt(self.w_max / PACKET * (1 - CUBIC_BETA) / CUBIC_C), self.cubic_k)
+        self.cwnd = np.where(cut, np.maximum(self.cwnd * self.aimd_beta, 2 * PACKET), self.cwnd)
+        self.epoch[cut] = 0
+        self.since_cut[cut] = 0
+        self.lost_acc[cut] = 0
+
+        # reno: one packet per RTT. cubic: W(t) = C(t - K)^3 + W_max in packets, never slower than reno
+        reno = self.cwnd + PACKET * dt / self.rtt
+        t = self.epoch - self.cubic_k
+        cubic = CUBIC_C * PACKET * t * t * t + self.w_max
+        slow_start = self.w_max == 0
+        grown = np.where(slow_start, self.cwnd + self.delivery * dt,
+                         np.where(self.is_cubic, np.maximum(cubic, reno), reno))
+        self.cwnd = np.where(active, np.maximum(grown, 2 * PACKET), self.cwnd)
+
+    def set_bandwidth(self, bw):
+        """change the bottleneck rate(Mbps) of every configuration from now on"""
+        self.capacity = np.broadcast_to(np.asarray(bw, dtype=float) * 1e6 / 8, self.capacity.shape).copy()
+
+    def run(self, sample_interval=0.1):
+        """simulate every configuration from now to its end
+
+        Args:
+            sample_interval (float, optional): interval of the returned series, 0.1 like the iperf logs. Defaults to 0.1.
+        Returns:
+            dict: 'time' (T,), 'throughput' (C, F, T) goodput in bits per second, 'rtt' (C, F, T) in ms,
+                'cwnd' (C, F, T) in payload bytes like iperf snd_cwnd, 'queue' (C, T) in bytes.
+                Samples outside a flow's lifetime are nan.
+        """
+        steps_per_sample = max(int(round(sample_interval / self.dt)), 1)
+        n_samples = int(np.ceil((self.end.max() - self.now) / (steps_per_sample * self.dt)))
+        shape = self.cc.shape + (n_samples,)
+        result = {'time': self.now + np.arange(n_samples) * steps_per_sample * self.dt,
+                  'throughput': np.full(shape, np.nan), 'rtt': np.full(shape, np.nan), 'cwnd': np.full(shape, np.nan),
+                  'queue': np.zeros((self.cc.shape[0], n_samples))}
+        for i in range(n_samples):
+            delivered = np.zeros(self.cc.shape)
+            rtt = np.zeros(self.cc.shape)
+            window = np.zeros(self.cc.shape)
+            alive = self.active()
+            for _ in range(steps_per_sample):
+                self.step()
+                delivered += self.delivery * self.dt
+                rtt += self.rtt
+                window += self.window
+            result['throughput'][..., i] = np.where(alive, delivered * 8 * MSS / PACKET / (steps_per_sample * self.dt), np.nan)
+            result['rtt'][..., i] = np.where(alive, rtt / steps_per_sample * 1000, np.nan)
+            result['cwnd'][..., i] = np.where(alive, window / steps_per_sample * MSS / PACKET, np.nan)
+            result['queue'][:, i] = self.queue
+        return result
+
+def summarize(configs, result):
+    """per flow mean goodput(Mbps) and RTT(ms), plus utilization, jain fairness and mean queue of every configuration"""
+    throughput = result['throughput']
+    n_flows = np.array([len(_['cctypes']) for _ in configs])
+    valid = ~np.isnan(throughput)
+    alive = valid.sum(axis=2)
+    # means over every configuration at once, flows that never ran(padding) stay nan
+    x = np.where(alive > 0, np.where(valid, throughput, 0).sum(axis=2) / np.maximum(alive, 1), np.nan)
+    rtt = np.where(alive > 0, np.where(valid, result['rtt'], 0).sum(axis=2) / np.maximum(alive, 1), np.nan)
+    busy = valid.any(axis=1)
+    n_busy = np.maximum(busy.sum(axis=1), 1)
+    total = np.where(valid, throughput, 0).sum(axis=1)
+    utilization = (total * busy).sum(axis=1) / n_busy / (np.array([_['bw'] for _ in configs]) * 1e6)
+    queue = (result['queue'] * busy).sum(axis=1) / n_busy
+    square = np.nansum(x ** 2, axis=1)
+    fairness = np.where(square > 0, np.nansum(x, axis=1) ** 2 / (n_flows * np.maximum(square, 1e-300)), 0)
+    return [{'config': config, 'throughput': list(x[c, :n] / 1e6), 'rtt': list(rtt[c, :n]),
+             'utilization': float(utilization[c]), 'fairness': float(fairness[c]), 'queue': float(queue[c])}
+            for c, (config, n) in enumerate(zip(configs, n_flows))]
+
+def simulate(configs, dt=0.001, buffer_pkts=BUFFER_PKTS, seed=0, sample_interval=0.1):
+    """run configs in one batch and return (result, summary), refer to FluidModel.run and summarize"""
+    result = FluidModel(configs, dt=dt, buffer_pkts=buffer_pkts, seed=seed).run(sample_interval)
+    return result, summarize(configs, result)
+
+def prune_dt(config, steps_per_rtt=PRUNE_STEPS_PER_RTT):
+    """time step of config in the pruning pass: its smallest propagation RTT over steps_per_rtt, rounded down to
+    a power of two milliseconds so configurations of similar RTT share a batch
+    """
+    n = len(config['cctypes'])
+    rtt = min(2 * (parse_delay(_) + BOTTLENECK_DELAY) + config.get('host_delay', 0)
+              for _ in config.get('delays') or [config['delay']] * n)
+    return 0.001 * 2 ** max(int(np.floor(np.log2(rtt / steps_per_rtt / 0.001))), 0)
+
+def prune(configs, steps_per_rtt=PRUNE_STEPS_PER_RTT, buffer_pkts=BUFFER_PKTS, seed=0):
+    """coarse pass over a sweep to pick the configurations worth a fine simulation or a testbed run. Every
+    configuration is stepped steps_per_rtt times per RTT instead of every millisecond, configurations are
+    batched by their time step(prune_dt). Refer to prune_error for the error against simulate
+
+    Returns:
+        list: summary rows like simulate, in the order of configs
+    """
+    groups = collections.defaultdict(list)
+    for c, config in enumerate(configs):
+        groups[prune_dt(config, steps_per_rtt)].append(c)
+    summary = [None] * len(configs)
+    for dt, indexes in groups.items():
+        batch = [configs[_] for _ in indexes]
+        result = FluidModel(batch, dt=dt, buffer_pkts=buffer_pkts, seed=seed).run(max(dt, 0.1))
+        for c, row in zip(indexes, summarize(batch, result)):
+            summary[c] = row
+    return summary
+
+def prune_error(configs, steps_per_rtt=PRUNE_STEPS_PER_RTT, **kwargs):
+    """mean abs relative error of prune against simulate(dt=0.001, the step validate uses against the testbed)
+    over configs, for per flow throughput and RTT and the jain fairness
+
+    Returns:
+        dict: error of every metric
+    """
+    fine = simulate(configs, **kwargs)[1]
+    coarse = prune(configs, steps_per_rtt=steps_per_rtt, **kwargs)
+    def error(key):
+        a = np.concatenate([np.atleast_1d(_[key]) for _ in coarse])
+        b = np.concatenate([np.atleast_1d(_[key]) for _ in fine])
+        ok = ~np.isnan(a) & ~np.isnan(b) & (b != 0)
+        return float(np.mean(np.abs(a[ok] - b[ok]) / np.abs(b[ok])))
+    return {key: error(key) for key in ['throughput', 'rtt', 'fairness']}
+
+def grid_configs(**params):
+    """cartesian product of parameter lists into configurations, e.g.
+    grid_configs(cctypes=[['bbr', 'cubic']], bw=[10, 100], delay=['10ms', '100ms'], loss=[0, 1], duration=[30])
+    """
+    keys = list(params)
+    return [dict(zip(keys, values)) for values in itertools.product(*params.values())]
+
+def validate(logs_path='./logs', send_file='analysis_send.csv', output_file='fluid_validation.csv', **kwargs):
+    """simulate every testbed experiment that has a metadata.json and compare with its iperf sender records
+    (analysis_send.csv from analyzer/iperf_analyzer.py), write per flow errors into output_file
+
+    Returns:
+        list: rows of output_file
+    """
+    measured = collections.defaultdict(lambda: collections.defaultdict(list))
+    for row in csv.DictReader(open(send_file)):
+        measured[row['experiment_id']][row['host'].split("_")[0]].append(row)
+
+    experiments, configs = [], []
+    for dirname in sorted(measured):
+        metadata_file = os.path.join(logs_path, dirname, 'metadata.json')
+        if not os.path.exists(metadata_file):
+            continue
+        with open(metadata_file) as f:
+            metadata = json.load(f)
+        if not all(_ in CC_CODES for _ in metadata['cctypes']):
+            continue
+        experiments.append(dirname)
+        configs.append(metadata)
+    if not configs:
+        return []
+    _, summary = simulate(configs, **kwargs)
+
+    rows = []
+    for dirname, config, simulated in zip(experiments, configs, summary):
+        for i, cctype in enumerate(config['cctypes']):
+            records = measured[dirname].get(f'hs{i + 1}')
+            if not records:
+                continue
+            throughput = np.mean([float(_['bits_per_second']) for _ in records]) / 1e6
+            # iperf reports rtt in microsecond
+            rtt = np.mean([float(_['rtt']) for _ in records]) / 1000
+            rows.append({
+                'experiment_id': dirname, 'host': f'hs{i + 1}', 'cctype': cctype,
+                'measured_throughput': throughput, 'simulated_throughput': simulated['throughput'][i],
+                'throughput_error': (simulated['throughput'][i] - throughput) / throughput if throughput else 0,
+                'measured_rtt': rtt, 'simulated_rtt': simulated['rtt'][i],
+                'rtt_error': (simulated['rtt'][i] - rtt) / rtt if rtt else 0,
+            })
+    with open(output_file, 'w') as f:
+        writer = csv.DictWriter(f, fieldnames=list(rows[0]) if rows else ['experiment_id'])
+        writer.writeheader()
+        writer.writerows(rows)
+    if rows:
+        print(f"{len(rows)} flows, mean abs throughput error {np.mean([abs(_['throughput_error']) for _ in rows]):.1%}, "
+              f"mean abs rtt error {np.mean([abs(_['rtt_error']) for _ in rows]):.1%}")
+    return rows
+
+if __name__ == '__main__':
+    validate()
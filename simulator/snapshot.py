@@ -0,0 +1,134 @@
+"""Snapshot a running simulation and fork it into parameter variants.
+
+Every variant of a what-if question(capacity drop, a new flow joining, another gain) usually shares
+the same warm-up: flows through STARTUP into a converged ProbeBW. Simulate the warm-up once, snapshot
+it, then continue each variant from the snapshot in its own process:
+
+    net = Dumbbell([40000, 40000])
+    net.run(10)
+    snap = snapshot(net)
+    results = fork(snap, [SetBandwidth(50), AddFlows([10000])], duration_s=10)
+
+A snapshot is the pickled simulator, it works for bbr_engine.Dumbbell and fluid_model.FluidModel
+since their whole state(including the random generator) lives in numpy arrays on the object.
+"""
+import sys
+import pickle
+import multiprocessing
+from simulator.executor import Executor
+
+def snapshot(sim, filename=None):
+    """serialize the whole simulator state, also write it to filename if given
+
+    Returns:
+        bytes: the snapshot
+    """
+    data = pickle.dumps(sim, protocol=pickle.HIGHEST_PROTOCOL)
+    if filename:
+        with open(filename, 'wb') as f:
+            f.write(data)
+    return data
+
+def restore(snap):
+    """a new simulator from a snapshot(bytes) or the file it was written to"""
+    if isinstance(snap, str):
+        with open(snap, 'rb') as f:
+            snap = f.read()
+    return pickle.loads(snap)
+
+
+class SetBandwidth():
+    """change the bottleneck rate(Mbps) at the fork point"""
+    def __init__(self, bw):
+        self.bw = bw
+
+    def __call__(self, sim):
+        sim.set_bandwidth(self.bw)
+
+    def __repr__(self):
+        return f"bw={self.bw}Mbps"
+
+
+class AddFlows():
+    """start new flows with the given propagation RTTs(us) at the fork point, Dumbbell only"""
+    def __init__(self, rtt_us):
+        self.rtt_us = list(rtt_us)
+
+    def __call__(self, sim):
+        sim.add_flows(self.rtt_us)
+
+    def __repr__(self):
+        return f"add rtt={self.rtt_us}us"
+
+
+class SetParam():
+    """override a module constant of the simulator, e.g. SetParam('PACING_GAIN', [...]). run_variant restores
+    the original value when the variant is done, since the worker process runs other variants next. Constants
+    copied into the flow state on a mode change(like CWND_GAIN) only take effect at the next change.
+    """
+    def __init__(self, name, value):
+        self.name = name
+        self.value = value
+
+    def module(self, sim):
+        module = sys.modules[type(sim).__module__]
+        if not hasattr(module, self.name):
+            raise ValueError(f"{module.__name__} has no parameter {self.name}")
+        return module
+
+    def __call__(self, sim):
+        setattr(self.module(sim), self.name, self.value)
+
+    def __repr__(self):
+        return f"{self.name}={self.value}"
+
+
+def run_variant(snap, variant, duration_s):
+    """continue a snapshot with the changes of variant, module constants overridden by SetParam are put back
+    afterwards(as executor.replay_job does) so they don't leak into the next job of the worker
+    """
+    sim = restore(snap)
+    saved = []
+    try:
+        for change in variant if isinstance(variant, (list, tuple)) else [variant]:
+            if isinstance(change, SetParam):
+                module = change.module(sim)
+                saved.append((module, change.name, getattr(module, change.name)))
+            change(sim)
+        return sim.run() if duration_s is None else sim.run(duration_s)
+    finally:
+        for module, name, value in reversed(saved):
+            setattr(module, name, value)
+
+def fork(snap, variants, duration_s=None, processes=None):
+    """continue a snapshot once per variant in parallel worker processes
+
+    Args:
+        snap (bytes|str): snapshot or its file
+        variants (list): each one a change(SetBandwidth, AddFlows, SetParam or any picklable callable
+            taking the simulator) or a list of changes, None continues unchanged as the baseline
+        duration_s (float, optional): seconds to simulate after the fork for Dumbbell, FluidModel runs until
+            the end of its configurations and takes None. Defaults to None.
+        processes (int, optional): worker processes. Defaults to the cpu count.
+    Returns:
+        list: what sim.run returned for every variant, in order
+    """
+    variants = [[] if _ is None else _ for _ in variants]
+    # the snapshot is sent once per variant, refer to executor.py
+    executor = Executor(processes or min(len(variants), multiprocessing.cpu_count()))
+    for variant in variants:
+        executor.submit(run_variant, snap, variant, duration_s)
+    jobs = executor.run()
+    for job in jobs:
+        if job.error:
+            raise RuntimeError(f"variant {variants[job.id]!r} failed:\n{job.error}")
+    return [_.result for _ in jobs]
+
+if __name__ == '__main__':
+    from simulator.bbr_engine import Dumbbell
+    net = Dumbbell([40000, 40000], bw_mbps=100, seed=0)
+    net.run(10)
+    snap = snapshot(net)
+    variants = [None, SetBandwidth(50), AddFlows([10000]), AddFlows([100000]), SetParam('PACING_GAIN', [384, 192] + [256] * 6)]
+    for variant, goodput in zip(variants, fork(snap, variants, duration_s=10)):
+        print(f"{variant!r:>24}: " + " ".join(f"{_:6.1f}" for _ in goodput.mean(axis=0)) + " Mbps")
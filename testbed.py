@@ -9,17 +9,74 @@ from mininet.node import Node
 from mininet.topo import Topo
 from mininet.cli import CLI
 from mininet.link import TCLink, TCIntf
-from util import iperf_cmd, genericCC_PATH, copa_sender_cmd, set_kernel_cc_algorithm, print_t
+from mininet.nodelib import LinuxBridge
+from util import iperf_cmd, genericCC_PATH, copa_sender_cmd, set_kernel_cc_algorithm, print_t, ss_sample_cmd, qdisc_sample_cmd, \
+    netem_change_cmd, ecn_marking_cmds, route_cc_cmd, tcpgen_cmd, incast_cmd, crossgen_cmd, video_cmd, \
+    sender_stack_cmds, sysctls_per_namespace, set_global_sysctls, STACK_SYSCTLS
+from log_offload import LogOffloader
 import time
 import os
 import _thread
 import platform
+import json
 
 # MININET_PATH = '/root/mininet'
 LOG_PATH = 'logs/'
+STATE_SAMPLE_INTERVAL = 0.05 # seconds between two ss/tc samples when trace_state is set
+BOTTLENECK_DELAY = "1ms" # delay of the s1-s2 link
 KERNEL_VERSION = platform.uname().release
+def half_delay(delay):
+    """split a delay like '10ms' in half, one half for the sender link and one for the receiver link"""
+    delay = float(delay[:-2])/2
+    return f"{delay}ms"
+
+def resolve_delays(delays, n):
+    """turn a per host pair delay assignment into a list of n delay strings
+
+    Args:
+        delays (list or function): a list of n delays (e.g. ['10ms', '50ms']), or a function
+            called with the pair index (1..n) returning its delay, e.g. to draw from a distribution
+        n (int): nums of host pairs
+    Returns:
+        list: delay of each host pair, None if delays is None
+    """
+    if delays is None:
+        return None
+    if callable(delays):
+        return [delays(i) for i in range(1, n+1)]
+    if len(delays) != n:
+        raise ValueError(f"got {len(delays)} delays for {n} host pairs")
+    return list(delays)
+
+def resolve_workloads(workloads, n):
+    """turn a workload assignment into a list of n workloads, like resolve_delays
+
+    Args:
+        workloads (dict or list): what the senders run instead of a greedy flow, one dict for every pair or
+            a list of n. {'type': 'bulk'} is the default greedy flow, {'type': 'cbr', 'rate': 5} a stream capped
+            at 5Mbps, {'type': 'video', ...} a video player on the receiver, the other keys are passed to
+            util.video_cmd(e.g. 'ladder', 'segment', 'max_buffer')
+        n (int): nums of host pairs
+    Returns:
+        list: workload of each host pair, None if workloads is None
+    """
+    if workloads is None:
+        return None
+    if isinstance(workloads, dict):
+        return [workloads] * n
+    if len(workloads) != n:
+        raise ValueError(f"got {len(workloads)} workloads for {n} host pairs")
+    return list(workloads)
+
+def workload_string(workloads):
+    """workload part of the log dir name, like '_workload=video-cbr5', empty when all pairs are bulk"""
+    if not workloads or all(_['type'] == 'bulk' for _ in workloads):
+        return ""
+    return "_workload=" + "-".join(f"{_['type']}{_.get('rate', '')}" for _ in workloads)
+
 class MyTopo(Topo):
-    def build(self, n=2, delay="10ms", loss=0, bw=10, jitter=None):
+    def build(self, n=2, delay="10ms", loss=0, bw=10, jitter=None, delays=None, shape_access=True, receivers=None,
+              cross=False):
         """create topology by specified parameters
         Args:
             n (int, optional): nums of host pairs(n receiver and n sender). Defaults to 2.
@@ -27,37 +84,115 @@ class MyTopo(Topo):
             loss (int, optional): loss (e.g. '1%' ). Defaults to 0.
             bw (int, optional): bandwidth in mb/s (e.g. 10 for '10m'). Defaults to 10mbps.
             jitter (_type_, optional): jitter (e.g. '1ms'). Defaults to None.
+            delays (list, optional): per host pair delay (e.g. ['10ms', '50ms']), overrides delay so that
+                each pair hs{i} -> hr{i} has its own RTT. Defaults to None(all pairs use delay).
+            shape_access (bool, optional): also limit bandwidth on the host links. If False only the s1-s2
+                bottleneck is rate limited, host links only add delay, which saves one htb qdisc per link.
+                Defaults to True.
+            receivers (int, optional): nums of receivers, 1 makes a many to one(incast) topology where all
+                senders reach hr1, with the delay of the first pair. Defaults to None(one receiver per sender).
+            cross (bool, optional): add a cross traffic sender hx1 on s1 and a sink hy1 on s2, with the delay of
+                the first pair. They sort after hs*, so the test hosts keep their addresses. Defaults to False.
         """  
         senderHosts = [self.addHost(f'hs{x}') for x in range(1, n+1)]
-        receiverHosts = [self.addHost(f'hr{x}') for x in range(1, n+1)]
+        receiverHosts = [self.addHost(f'hr{x}') for x in range(1, (receivers or n)+1)]
         s1 = self.addSwitch('s1')
         s2 = self.addSwitch('s2')
         
         # split delay into 2 links
-        delay = int(delay[:-2])/2
-        delay = f"{delay}ms"
+        if delays is None:
+            delays = [delay] * n
+        delays = [half_delay(_) for _ in delays]
         
-        self.addLink(s1, s2, delay="1ms", loss=loss, bw=bw, jitter=jitter)
-        for senderHost in senderHosts:
+        access_bw = bw if shape_access else None
+        
+        self.addLink(s1, s2, delay=BOTTLENECK_DELAY, loss=loss, bw=bw, jitter=jitter)
+        for senderHost, delay in zip(senderHosts, delays):
             #link configuration could refer to mininet.link.config function
-            self.addLink(senderHost, s1, delay=delay, loss=0, bw=bw, jitter=jitter)
-        for recevierHost in receiverHosts:
-            self.addLink(recevierHost, s2, delay=delay, loss=0, bw=bw, jitter=jitter)
+            self.addLink(senderHost, s1, delay=delay, loss=0, bw=access_bw, jitter=jitter)
+        for recevierHost, delay in zip(receiverHosts, delays):
+            self.addLink(recevierHost, s2, delay=delay, loss=0, bw=access_bw, jitter=jitter)
+        if cross:
+            self.addLink(self.addHost('hx1'), s1, delay=delays[0], loss=0, bw=access_bw, jitter=jitter)
+            self.addLink(self.addHost('hy1'), s2, delay=delays[0], loss=0, bw=access_bw, jitter=jitter)
+
+def delay_string(delay, delays=None, delay_steps=None):
+    """delay part of the log dir name, per pair delays are joined like '10ms-50ms',
+    delay steps are appended like '10ms_steps=20s+80ms'
+    """
+    result = "-".join(delays) if delays else delay
+    if delay_steps:
+        result += "_steps=" + "-".join(f"{at}s+{added}" for at, added in delay_steps)
+    return result
+
+def cross_string(cross_traffic):
+    """cross traffic part of the log dir name, like '_cross=udp_rate20-flow_rate5', empty without cross traffic"""
+    if not cross_traffic:
+        return ""
+    return "_cross=" + "-".join(f"{key}{os.path.basename(str(value))}" for key, value in sorted(cross_traffic.items()))
+
+def stack_string(sender_stack):
+    """sender stack part of the log dir name, like '_stack=qdiscfq-tso0', empty without stack options"""
+    if not sender_stack:
+        return ""
+    return "_stack=" + "-".join(f"{key}{int(value) if isinstance(value, bool) else str(value).replace(' ', ':')}"
+                                for key, value in sorted(sender_stack.items()))
 
 class CCTest():
-    def __init__(self, clean_logs=False, monitor_type="both", DEBUG=False):
+    def __init__(self, clean_logs=False, monitor_type="both", DEBUG=False, switch_type="ovs", shape_access=True,
+                 offload_logs=False, trace_state=False, ecn_threshold=None, traffic_generator="iperf"):
         """
         Args:
             clean_logs (bool, optional): _description_. Defaults to False.
             monitor_type (str, optional): The monitor tool to use, 'ifstat' use to record by 100 microsecond
             'ethstats' use to record by second. Defaults to "both".
+            switch_type (str, optional): datapath of s1 and s2, 'ovs' use mininet default Open vSwitch with a controller,
+            'bridge' use plain linux bridges without controller, which costs less cpu per packet and
+            allows higher rates and more hosts. Defaults to "ovs".
+            shape_access (bool, optional): rate limit the host links too, refer to MyTopo.build. Defaults to True.
+            offload_logs (bool, optional): write logs to tmpfs during the run and let a background thread gzip them
+            into logs/, refer to log_offload.LogOffloader. Call close() after the last test. Defaults to False.
+            trace_state (bool, optional): sample tcp_info of every sender with ss and the bottleneck queue with tc,
+            and keep the kernel log for bbr2 debug lines, used by analyzer/trace_exporter.py. Defaults to False.
+            ecn_threshold (int, optional): mark CE at the bottleneck once more than this many packets are queued
+            (DCTCP style step marking, refer to util.ecn_marking_cmds). Only 'bbr2_ecn' flows negotiate ECN and
+            react to the marks, the other hosts keep the default net.ipv4.tcp_ecn(accept, never request), so
+            their flows see the queue like a tail drop one. Defaults to None(tail drop, no ECN).
+            traffic_generator (str, optional): bulk flow tool of kernel cc algorithms, 'iperf' use iperf3,
+            'tcpgen' use tools/tcpgen(refer to util.tcpgen_cmd), which doesn't copy data through userspace
+            and keeps the sender from being cpu bound at multi-gigabit rates. Defaults to "iperf".
         """
+        if switch_type not in ["ovs", "bridge"]:
+            raise ValueError(f"Unknown switch type: {switch_type}")
+        if traffic_generator not in ["iperf", "tcpgen"]:
+            raise ValueError(f"Unknown traffic generator: {traffic_generator}")
+        self.traffic_generator = traffic_generator
+        self.switch_type = switch_type
+        self.shape_access = shape_access
         self.monitor_type = monitor_type
         self.clean_logs = clean_logs
         self.DEBUG = DEBUG
-        pass
+        self.trace_state = trace_state
+        self.ecn_threshold = ecn_threshold
+        self.offloader = LogOffloader(LOG_PATH) if offload_logs else None
+        self.saved_sysctls = None
     
-    def test_single_cc(self, cctype="cubic", n=2, delay="10ms", loss=0, bw=10, jitter=None, duration=60, start_delay=0):
+    def make_logs_dir(self, name):
+        """create the log dir of an experiment, on tmpfs if logs are offloaded"""
+        if self.offloader:
+            return self.offloader.staging_dir(name)
+        logs_dirname = f"./{LOG_PATH}" + name
+        os.makedirs(logs_dirname, exist_ok=True)
+        return logs_dirname
+    
+    def close(self):
+        """wait for the offloaded logs to be written into logs/"""
+        if self.offloader:
+            self.offloader.close()
+            self.offloader = None
+    
+    def test_single_cc(self, cctype="cubic", n=2, delay="10ms", loss=0, bw=10, jitter=None, duration=60, start_delay=0,
+                       delays=None, delay_steps=None, cross_traffic=None, workloads=None, sender_stack=None):
         """create topology based on parameter, running iperf test between pairs, write the throughput records into files 
         Args:
             cctype(str): the algorithm used in test, options: "cubic", "bbr", "copa", "reno"
@@ -68,29 +203,52 @@ class CCTest():
             jitter (_type_, optional): _description_. Defaults to None.
             duration(int): the last time for the test. Defaults to 60 seconds.
             start_delay(float): different lines start one by one with delay, if set 0, all the connection will start at the same time.
+            delays (list or function, optional): per host pair delay, refer to resolve_delays. Defaults to None.
+            delay_steps (list, optional): route changes during the run, refer to schedule_delay_steps. Defaults to None.
+            cross_traffic (dict, optional): background traffic from hx1 to hy1 through the bottleneck, keyword
+                arguments of util.crossgen_cmd, e.g. {'udp_rate': 20, 'flow_rate': 5}. Defaults to None.
+            workloads (dict or list, optional): video or rate capped streams instead of greedy flows, refer to
+                resolve_workloads. Kernel cc only. Defaults to None(all bulk).
+            sender_stack (dict, optional): network stack of the senders, e.g. {'qdisc': 'fq', 'tso': False,
+                'tcp_limit_output_bytes': 262144}, refer to util.sender_stack_cmds. Defaults to None(host defaults).
         """
-        net = self.generate_network(n, bw, delay, loss, jitter)
+        delays = resolve_delays(delays, n)
+        workloads = resolve_workloads(workloads, n)
+        net = self.generate_network(n, bw, delay, loss, jitter, delays=delays, cross=bool(cross_traffic))
+        if sender_stack:
+            sender_stack = self.configure_sender_stack(net, n, sender_stack)
         
         #create log dir name
         time_id = time.strftime("%Y-%m-%d-%H-%M-%S", time.localtime()) 
-        parameter_string = f"{cctype}_{n}hosts_delay={delay}_loss={loss}_bw={bw}_duration={duration}_start_delay={start_delay}_{KERNEL_VERSION}"
+        parameter_string = f"{cctype}_{n}hosts_delay={delay_string(delay, delays, delay_steps)}_loss={loss}_bw={bw}_duration={duration}_start_delay={start_delay}{cross_string(cross_traffic)}{workload_string(workloads)}{stack_string(sender_stack)}_{KERNEL_VERSION}"
         print_t("stress", f"current Test: single cc algorithm test paramets: {parameter_string}")
-        logs_dirname = f"./{LOG_PATH}" + time_id + "_" + parameter_string
-        os.makedirs(logs_dirname, exist_ok=True)
-        
-        self.monitor_network(net.getNodeByName('s2'), logs_dirname, duration=duration)
+        logs_dirname = self.make_logs_dir(time_id + "_" + parameter_string)
         
+
         # run the tests
         cctypes = [cctype] * n
-        self.run_test_by_ctype(cctypes, net, start_delay, logs_dirname, duration=duration)
+        self.write_metadata(logs_dirname, net=net, cctypes=cctypes, delay=delay, delays=delays, loss=loss, bw=bw,
+                            jitter=jitter, duration=duration, start_delay=start_delay, delay_steps=delay_steps,
+                            cross_traffic=cross_traffic, workloads=workloads, sender_stack=sender_stack)
+        self.monitor_network(net.getNodeByName('s2'), logs_dirname, duration=duration)
+        if self.trace_state:
+            self.monitor_state(net, cctypes, logs_dirname, duration=duration + start_delay * len(cctypes),
+                               workloads=workloads)
+        if delay_steps:
+            self.schedule_delay_steps(net, delay_steps, bw, loss, jitter)
+        if cross_traffic:
+            self.start_cross_traffic(net, cross_traffic, logs_dirname, duration=duration + start_delay * n)
+        
+        self.run_test_by_ctype(cctypes, net, start_delay, logs_dirname, duration=duration, workloads=workloads)
                 
         sleep(duration + 5 + start_delay * n )
         net.stop()
+        self.restore_sender_stack()
         
-        if self.clean_log:
-            self.clean_log(logs_dirname)
+        self.clean_log(logs_dirname)
     
-    def test_multi_cc(self, cc1, cc2, cc1_host_n=1, cc2_host_n=1, delay="10ms", loss=0, bw=10, jitter=None, duration=60, start_delay=0):
+    def test_multi_cc(self, cc1, cc2, cc1_host_n=1, cc2_host_n=1, delay="10ms", loss=0, bw=10, jitter=None, duration=60, start_delay=0,
+                      delays=None, delay_steps=None, cross_traffic=None, workloads=None, sender_stack=None):
         """like test_single_cc, but use different cc algorithms on hosts
         Args:
             cc1 (_type_): first cc algorithm,  could be "cubic", "bbr", "copa", "reno", "bbrplus"
@@ -99,39 +257,160 @@ class CCTest():
             cc2_host_n (int, optional): _description_. Defaults to 1.
             others: refer to test_single_cc parameters
         """
-        net = self.generate_network(cc1_host_n + cc2_host_n, bw, delay, loss, jitter)
+        delays = resolve_delays(delays, cc1_host_n + cc2_host_n)
+        workloads = resolve_workloads(workloads, cc1_host_n + cc2_host_n)
+        net = self.generate_network(cc1_host_n + cc2_host_n, bw, delay, loss, jitter, delays=delays,
+                                    cross=bool(cross_traffic))
+        if sender_stack:
+            sender_stack = self.configure_sender_stack(net, cc1_host_n + cc2_host_n, sender_stack)
         
         #create log dir name
         time_id = time.strftime("%Y-%m-%d-%H-%M-%S", time.localtime()) 
-        parameter_string = f"{cc1}{cc1_host_n}_{cc2}{cc2_host_n}_delay={delay}_loss={loss}_bw={bw}_duration={duration}_start_delay={start_delay}_{KERNEL_VERSION}"
+        parameter_string = f"{cc1}{cc1_host_n}_{cc2}{cc2_host_n}_delay={delay_string(delay, delays, delay_steps)}_loss={loss}_bw={bw}_duration={duration}_start_delay={start_delay}{cross_string(cross_traffic)}{workload_string(workloads)}{stack_string(sender_stack)}_{KERNEL_VERSION}"
         print_t("stress", f"current Test: single cc algorithm test paramets: {parameter_string}")
-        logs_dirname = "./logs/" + time_id + "_" + parameter_string
-        os.makedirs(logs_dirname, exist_ok=True)
-        
-        self.monitor_network(net.getNodeByName('s2'), logs_dirname, duration=duration)
+        logs_dirname = self.make_logs_dir(time_id + "_" + parameter_string)
         
+
         # run the tests
         cctypes = [cc1] * cc1_host_n + [cc2] * cc2_host_n
-        self.run_test_by_ctype(cctypes, net, start_delay, logs_dirname, duration=duration)
+        self.write_metadata(logs_dirname, net=net, cctypes=cctypes, delay=delay, delays=delays, loss=loss, bw=bw,
+                            jitter=jitter, duration=duration, start_delay=start_delay, delay_steps=delay_steps,
+                            cross_traffic=cross_traffic, workloads=workloads, sender_stack=sender_stack)
+        self.monitor_network(net.getNodeByName('s2'), logs_dirname, duration=duration)
+        if self.trace_state:
+            self.monitor_state(net, cctypes, logs_dirname, duration=duration + start_delay * len(cctypes),
+                               workloads=workloads)
+        if delay_steps:
+            self.schedule_delay_steps(net, delay_steps, bw, loss, jitter)
+        if cross_traffic:
+            self.start_cross_traffic(net, cross_traffic, logs_dirname,
+                                     duration=duration + start_delay * (cc1_host_n + cc2_host_n))
+        
+        self.run_test_by_ctype(cctypes, net, start_delay, logs_dirname, duration=duration, workloads=workloads)
                 
         sleep(duration + 5 + start_delay * (cc1_host_n + cc2_host_n)) #
         net.stop()
-        if self.clean_log:
-            self.clean_log(logs_dirname)
+        self.restore_sender_stack()
+        self.clean_log(logs_dirname)
             
-    def generate_network(self, n, bw, delay, loss, jitter):
+    def test_incast(self, cctype="cubic", n=8, delay="1ms", loss=0, bw=100, jitter=None, response_size=65536,
+                    requests=100, gap=0.1, duration=30, delays=None):
+        """incast: n senders(responders) answer every request of one receiver(aggregator hr1) at the same time,
+        the responses meet at the bottleneck. Records the completion time of every request into hr1_incast.bin
+        and the bottleneck qdisc counters after the run into queue_final.log, refer to analyzer/incast_analyzer.py
+        Args:
+            cctype (str): kernel cc algorithm of the responders, e.g. "cubic", "bbr", "bbr2"
+            n (int, optional): fan in, nums of responders. Defaults to 8.
+            response_size (int, optional): bytes every responder sends per request. Defaults to 65536.
+            requests (int, optional): nums of requests. Defaults to 100.
+            gap (float, optional): seconds between the end of a request and the next one. Defaults to 0.1.
+            duration (int, optional): upper bound of the run in seconds, the monitors run this long and the
+                aggregator is stopped after it. Defaults to 30.
+            others: refer to test_single_cc parameters
+        """
+        delays = resolve_delays(delays, n)
+        net = self.generate_network(n, bw, delay, loss, jitter, delays=delays, receivers=1)
+
+        time_id = time.strftime("%Y-%m-%d-%H-%M-%S", time.localtime())
+        parameter_string = f"incast_{cctype}_{n}hosts_delay={delay_string(delay, delays)}_loss={loss}_bw={bw}_response={response_size}_requests={requests}_{KERNEL_VERSION}"
+        print_t("stress", f"current Test: incast test paramets: {parameter_string}")
+        logs_dirname = self.make_logs_dir(time_id + "_" + parameter_string)
+
+        cctypes = [cctype] * n
+        self.write_metadata(logs_dirname, net=net, cctypes=cctypes, delay=delay, delays=delays, loss=loss, bw=bw, jitter=jitter,
+                            duration=duration, start_delay=0, incast=True, response_size=response_size,
+                            requests=requests, gap=gap)
+        self.monitor_network(net.getNodeByName('s2'), logs_dirname, duration=duration)
+
+        senderHosts = [net.getNodeByName(f'hs{i}') for i in range(1, n + 1)]
+        for senderHost in senderHosts:
+            senderHost.cmd(incast_cmd(side="responder", algorithm=cctype))
+        aggregator = incast_cmd(side="aggregator", addresses=[_.IP() for _ in senderHosts], algorithm=cctype,
+                                requests=requests, response_size=response_size, gap=gap,
+                                output_file=logs_dirname + '/hr1_incast.bin')
+        net.getNodeByName('hr1').cmd(f"timeout {duration} {aggregator}")
+        s1 = net.getNodeByName('s1')
+        # the s1-s2 link is added first, so s1-eth1 is the bottleneck egress
+        s1.cmd(f'(echo "# $(date +%s.%N)"; tc -s qdisc show dev s1-eth1) > {logs_dirname}/queue_final.log')
+        net.stop()
+        self.clean_log(logs_dirname)
+
+    def generate_network(self, n, bw, delay, loss, jitter, delays=None, receivers=None, cross=False):
         """generate a network by given topology and return the network"""
         cleanup()
-        topo = MyTopo(n=n, bw=bw, delay=delay, loss=loss, jitter=jitter)
-        net = Mininet(topo=topo, waitConnected=False, link=TCLink) # link=TCLink is important to enable link limits
+        topo = MyTopo(n=n, bw=bw, delay=delay, loss=loss, jitter=jitter, delays=delays, shape_access=self.shape_access,
+                      receivers=receivers, cross=cross)
+        if self.switch_type == "bridge":
+            # linux bridges forward by themselves, no controller needed
+            net = Mininet(topo=topo, waitConnected=False, link=TCLink, switch=LinuxBridge, controller=None)
+        else:
+            net = Mininet(topo=topo, waitConnected=False, link=TCLink) # link=TCLink is important to enable link limits
         print("links: ", topo.links())
         print("hosts: ", topo.hosts())
         net.start()
+        if self.ecn_threshold:
+            self.enable_ecn_marking(net, bw, loss, jitter)
         # start a new interactive cmd to debug
         if self.DEBUG:
             _thread.start_new_thread(lambda:CLI(net), () )
         return net
 
+    def enable_ecn_marking(self, net, bw, loss, jitter):
+        """turn the bottleneck into a DCTCP style marking queue, ECN is negotiated per socket by bbr2_ecn"""
+        if not bw:
+            raise ValueError("ECN marking needs a rate limited bottleneck(bw)")
+        s1 = net.getNodeByName('s1')
+        # the s1-s2 link is added first, so s1-eth1 is the bottleneck egress
+        for command in ecn_marking_cmds('s1-eth1', self.ecn_threshold, bw, BOTTLENECK_DELAY, loss=loss, jitter=jitter):
+            s1.cmd(command)
+
+    def configure_sender_stack(self, net, n, sender_stack):
+        """apply the stack options to every sender namespace, tcp_rmem goes to the receivers where it
+        sizes the receive window. Before linux 4.15 the tcp sysctls only exist in the root namespace, they are
+        set there once for every host and put back by restore_sender_stack after the run
+
+        Returns:
+            dict: the options as applied, with sysctl_scope 'global' when the sysctls were not per sender,
+                this is what goes into metadata.json and the dir name
+        """
+        applied = dict(sender_stack)
+        host_options = sender_stack
+        if not sysctls_per_namespace() and any(_ in sender_stack for _ in STACK_SYSCTLS):
+            self.saved_sysctls = set_global_sysctls(sender_stack)
+            host_options = {k: v for k, v in sender_stack.items() if k not in STACK_SYSCTLS}
+            applied['sysctl_scope'] = 'global'
+            print_t("warning", f"linux {KERNEL_VERSION} has no per namespace tcp sysctls, set them for every host")
+        try:
+            for i in range(1, n + 1):
+                senderHost, receiverHost = net.getNodeByName(f'hs{i}', f'hr{i}')
+                sender = {k: v for k, v in host_options.items() if k != 'tcp_rmem'}
+                for command in sender_stack_cmds(senderHost.defaultIntf().name, sender):
+                    self.run_checked(senderHost, command)
+                if 'tcp_rmem' in host_options:
+                    for command in sender_stack_cmds(receiverHost.defaultIntf().name,
+                                                     {'tcp_rmem': host_options['tcp_rmem']}):
+                        self.run_checked(receiverHost, command)
+        except RuntimeError:
+            net.stop()
+            self.restore_sender_stack()
+            raise
+        print_t("info", f"sender stack: {applied}")
+        return applied
+
+    def restore_sender_stack(self):
+        """put back the root namespace tcp sysctls changed by configure_sender_stack"""
+        if self.saved_sysctls:
+            set_global_sysctls(self.saved_sysctls)
+            self.saved_sysctls = None
+
+    def run_checked(self, host, command):
+        """run command on host, raise RuntimeError if it fails so a setting that was not applied is not
+        recorded as part of the experiment
+        """
+        output = host.cmd(f"{command} 2>&1; echo $?").strip().split("\n")
+        if output[-1].strip() != "0":
+            raise RuntimeError(f"{host.name}: '{command}' failed: {' '.join(output[:-1])}")
+
     def run_copa_test(self, senderHost, receiverHost, cctype, logs_dirname, duration):
         # for copa, use genericCC's sender/receiver scheme
         output_file = logs_dirname + f'/{senderHost.name}_copa.log'
@@ -141,10 +420,29 @@ class CCTest():
         senderHost.cmd(copa_sender_cmd(serverip=receiverHost.IP(), onduration=duration*1000, output_file=output_file))
         # print(f"{senderHost.name} sender init finished {time.strftime('%Y-%m-%d-%H-%M-%S', time.localtime())}")
 
-    def run_kernel_test(self, senderHost, receiverHost, cctype, logs_dirname, duration):
+    def run_kernel_test(self, senderHost, receiverHost, cctype, logs_dirname, duration, workload=None):
         # first set the tcp cc algorithm on host, duplicated since iperf3 can speficy the algorithm used
         # set_kernel_cc_algorithm(senderHost, cctype)
+        if cctype == "bbr2_ecn":
+            # the receiver socket sends the precise per packet CE feedback. iperf3 can't select the cc of the
+            # accepted socket, so only the route back to this sender selects it, the host default stays
+            receiverHost.cmd(route_cc_cmd(senderHost.IP(), receiverHost.defaultIntf().name, cctype))
         
+        workload = workload or {'type': 'bulk'}
+        if workload['type'] == "video":
+            # data flows from the server on the sender to the player on the receiver
+            senderHost.cmd(video_cmd(side="server", algorithm=cctype))
+            receiverHost.cmd(video_cmd(address=senderHost.IP(), time=duration, algorithm=cctype,
+                                       output_file=logs_dirname + f'/{receiverHost.name}_video.bin',
+                                       **{k: v for k, v in workload.items() if k != 'type'}))
+            return
+        if self.traffic_generator == "tcpgen" or workload['type'] == "cbr":
+            receiverHost.cmd(tcpgen_cmd(side="server", algorithm=cctype,
+                                        output_file=logs_dirname + f'/{receiverHost.name}_tcpgen.bin'))
+            senderHost.cmd(tcpgen_cmd(address=receiverHost.IP(), time=duration, algorithm=cctype,
+                                      rate=workload.get('rate'),
+                                      output_file=logs_dirname + f'/{senderHost.name}_tcpgen.bin'))
+            return
         # for cubic and bbr, use iperf scheme
         sender_output_file = logs_dirname + f'/{senderHost.name}_iperf.log'
         receiver_output_file = logs_dirname + f'/{receiverHost.name}_iperf.log'
@@ -156,8 +454,32 @@ class CCTest():
                                  ))
         # print(f"{senderHost.name} sender init finished {time.strftime('%Y-%m-%d-%H-%M-%S', time.localtime())}")
 
+    def write_metadata(self, logs_dirname, net=None, **parameters):
+        """save the experiment parameters into metadata.json under the log dir, so analyzers
+        don't need to parse them back from the dir name. With net, the address of every host is saved too,
+        e.g. to tell which flow a kernel debug line with a peer address belongs to
+        """
+        metadata = dict(parameters, kernel=KERNEL_VERSION, monitor_type=self.monitor_type,
+                        switch_type=self.switch_type, shape_access=self.shape_access, trace_state=self.trace_state,
+                        ecn_threshold=self.ecn_threshold, traffic_generator=self.traffic_generator)
+        metadata['hosts'] = [
+            {'sender': f'hs{i}', 'receiver': 'hr1' if metadata.get('incast') else f'hr{i}', 'cctype': cctype,
+             'delay': metadata['delays'][i-1] if metadata.get('delays') else metadata.get('delay'),
+             'workload': metadata['workloads'][i-1] if metadata.get('workloads') else {'type': 'bulk'}}
+            for i, cctype in enumerate(metadata['cctypes'], 1)
+        ]
+        if net:
+            metadata['addresses'] = {host.name: host.IP() for host in net.hosts}
+        with open(os.path.join(logs_dirname, 'metadata.json'), 'w') as f:
+            json.dump(metadata, f, indent=4)
+
     def clean_log(self, logs_dirname):
-        if self.clean_logs:
+        if self.offloader:
+            if self.clean_logs:
+                self.offloader.discard(logs_dirname)
+            else:
+                self.offloader.submit(logs_dirname)
+        elif self.clean_logs:
             del_list = os.listdir(logs_dirname)
             for file in del_list:
                 os.remove(os.path.join(logs_dirname, file))
@@ -175,13 +497,71 @@ class CCTest():
         if self.monitor_type in ["ethstats", "both"]:
             s2.cmd(f'ethstats -t -n 1 -c {duration+5} > {logs_dirname}/ethstats.log  2>&1 &')
     
-    def run_test_by_ctype(self, cctypes, net, start_delay, logs_dirname, duration):
+    def monitor_state(self, net, cctypes, logs_dirname, duration, workloads=None):
+        """sample sender tcp state into ss_hs{i}.log and the s1 -> s2 bottleneck queue into queue.log,
+        bbr2 debug lines go to bbr2_debug.log(needs /sys/module/tcp_bbr2/parameters/debug_with_printk and debug_port_mask)
+        """
+        count = int((duration + 5) / STATE_SAMPLE_INTERVAL)
+        for i in range(1, len(cctypes) + 1):
+            senderHost = net.getNodeByName(f'hs{i}')
+            workload = workloads[i-1]['type'] if workloads else "bulk"
+            # default server port of tcpgen and iperf3
+            port = 5202 if self.traffic_generator == "tcpgen" or workload != "bulk" else 5201
+            senderHost.cmd(ss_sample_cmd(interval=STATE_SAMPLE_INTERVAL, count=count, port=port,
+                                         output_file=f'{logs_dirname}/ss_hs{i}.log'))
+        s1 = net.getNodeByName('s1')
+        # the s1-s2 link is added first, so s1-eth1 is the bottleneck egress
+        s1.cmd(qdisc_sample_cmd('s1-eth1', interval=STATE_SAMPLE_INTERVAL, count=count, output_file=f'{logs_dirname}/queue.log'))
+        if "bbr2" in cctypes or "bbr2_ecn" in cctypes:
+            # kernel timestamps are uptime, keep epoch and uptime of the start to align them with ss samples
+            s1.cmd(f'echo "# $(date +%s.%N) $(cut -d" " -f1 /proc/uptime)" > {logs_dirname}/bbr2_debug.log')
+            s1.cmd(f'timeout {duration + 5} dmesg -w | grep --line-buffered " BBR " >> {logs_dirname}/bbr2_debug.log 2>&1 &')
+    
+    def schedule_delay_steps(self, net, delay_steps, bw, loss, jitter):
+        """emulate route changes: at each step add delay to the s1 -> s2 direction of the bottleneck link,
+        so the RTT of every flow grows by the added delay. Runs in a background thread from the test start.
+
+        Args:
+            delay_steps (list): (seconds from start, added delay) pairs, e.g. [(20, '80ms'), (40, '0ms')]
+                moves to a path 80ms longer at 20s and back at 40s
+            bw, loss, jitter: bottleneck link parameters, netem is rebuilt with them
+        """
+        s1 = net.getNodeByName('s1')
+        base = float(BOTTLENECK_DELAY[:-2])
+        def run_steps():
+            start = time.time()
+            for at, added in sorted(delay_steps):
+                sleep(max(at - (time.time() - start), 0))
+                delay = f"{base + float(added[:-2])}ms"
+                # the s1-s2 link is added first, so s1-eth1 is the bottleneck egress
+                parent = "6:" if self.ecn_threshold else "5:1" if bw else None
+                s1.cmd(netem_change_cmd('s1-eth1', delay, loss=loss, jitter=jitter, parent=parent))
+                print_t("info", f"bottleneck delay set to {delay} at {at}s")
+        _thread.start_new_thread(run_steps, ())
+
+    def start_cross_traffic(self, net, cross_traffic, logs_dirname, duration):
+        """start the crossgen sink on hy1 and the sender on hx1 with the tested flows, they log into
+        hx1_cross.log and hy1_cross.log
+
+        Args:
+            cross_traffic (dict): keyword arguments of util.crossgen_cmd, e.g. {'trace': 'traces/mawi.txt'}
+                or {'udp_rate': 20, 'mean_on': 0.5, 'mean_off': 2, 'flow_rate': 5, 'flow_size': 200000}
+            duration (int): seconds the sender runs
+        """
+        senderHost, sinkHost = net.getNodeByName('hx1', 'hy1')
+        sinkHost.cmd(crossgen_cmd(side="sink", output_file=f'{logs_dirname}/hy1_cross.log'))
+        sleep(0.5)
+        senderHost.cmd(crossgen_cmd(address=sinkHost.IP(), time=duration, output_file=f'{logs_dirname}/hx1_cross.log',
+                                    **cross_traffic))
+
+    def run_test_by_ctype(self, cctypes, net, start_delay, logs_dirname, duration, workloads=None):
         for _, cctype in enumerate(cctypes):
             i = _ + 1
             senderHost, receiverHost = net.getNodeByName(f'hs{i}', f'hr{i}')
-            if cctype in ["cubic", "bbr", "bbrplus", "bbr2"]:
+            if cctype in ["cubic", "bbr", "bbrplus", "bbr2", "bbr2_ecn"]:
                 _thread.start_new_thread(
-                    CCTest.run_kernel_test, (self, senderHost, receiverHost, cctype, logs_dirname, duration)
+                    CCTest.run_kernel_test, (self, senderHost, receiverHost, cctype, logs_dirname, duration,
+                                             workloads[_] if workloads else None)
                 )
                 # self.run_kernel_test(senderHost, receiverHost, cctype, logs_dirname, duration)
             elif cctype == "copa":
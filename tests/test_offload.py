@@ -0,0 +1,105 @@
+"""Logs(iperf json, tcpgen binary stats and video segments) offloaded gzipped by log_offload.LogOffloader must still reach the
+analysis csv files.
+
+    python3 -m unittest discover tests
+"""
+import os
+import sys
+import csv
+import json
+import shutil
+import tempfile
+import unittest
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [REPO_DIR, os.path.join(REPO_DIR, 'analyzer')]
+
+import iperf_analyzer
+import video_analyzer
+from log_offload import LogOffloader
+
+EXPERIMENT = "2022-04-26-22-50-25_bbr_1hosts_delay=40ms_loss=0_bw=100_duration=1_start_delay=0_5.13.12bbr2"
+
+
+def iperf_log(sender, intervals=10):
+    """iperf3 -J output with the fields iperf_analyzer reads"""
+    streams = []
+    for i in range(intervals):
+        stream = {'socket': 5, 'start': i * 0.1, 'end': (i + 1) * 0.1, 'seconds': 0.1, 'bytes': 125000,
+                  'bits_per_second': 1e7, 'omitted': False, 'sender': sender}
+        if sender:
+            stream.update(retransmits=0, snd_cwnd=14480, snd_wnd=3145728, rtt=40000, rttvar=100, pmtu=1500)
+        streams.append({'streams': [stream], 'sum': dict(stream)})
+    return json.dumps({'start': {'timestamp': {'timesecs': 1650000000}}, 'intervals': streams, 'end': {}},
+                      indent=4) + "\n"
+
+
+class OffloadedLogTest(unittest.TestCase):
+    def setUp(self):
+        self.root = tempfile.mkdtemp(prefix='offload_test_')
+        self.cwd = os.getcwd()
+        os.chdir(self.root)
+        self.logs_path = iperf_analyzer.logs_path
+        iperf_analyzer.logs_path = video_analyzer.logs_path = os.path.join(self.root, 'logs')
+
+    def tearDown(self):
+        iperf_analyzer.logs_path = video_analyzer.logs_path = self.logs_path
+        os.chdir(self.cwd)
+        shutil.rmtree(self.root)
+
+    def offload(self, files):
+        """write files into a staging dir and move it into logs/ like CCTest does"""
+        offloader = LogOffloader(os.path.join(self.root, 'logs'), staging_path=os.path.join(self.root, 'staging'))
+        dirname = offloader.staging_dir(EXPERIMENT)
+        for filename, content in files.items():
+            with open(os.path.join(dirname, filename), 'wb' if isinstance(content, bytes) else 'w') as f:
+                f.write(content)
+        offloader.submit(dirname)
+        offloader.close()
+
+    def read_csv(self, filename):
+        with open(filename) as f:
+            return list(csv.DictReader(f))
+
+    def test_offloaded_iperf_log(self):
+        self.offload({'hs1_iperf.log': iperf_log(True), 'hr1_iperf.log': iperf_log(False)})
+        self.assertEqual(sorted(os.listdir(os.path.join(self.root, 'logs', EXPERIMENT))),
+                         ['hr1_iperf.log.gz', 'hs1_iperf.log.gz'])
+        iperf_analyzer.extract_save_send_log([EXPERIMENT])
+        iperf_analyzer.extract_save_rec_log([EXPERIMENT])
+        send = self.read_csv(iperf_analyzer.send_log_file)
+        rec = self.read_csv(iperf_analyzer.rec_log_file)
+        self.assertEqual(len(send), 10)
+        self.assertEqual(len(rec), 10)
+        self.assertEqual({_['host'] for _ in send}, {'hs1_iperf.log'})
+        self.assertEqual(float(send[0]['rtt']), 40000)
+
+    def test_offloaded_tcpgen_log(self):
+        header = iperf_analyzer.TCPGEN_HEADER.pack(b'TGEN', 1, iperf_analyzer.TCPGEN_RECORD.size, 1, 1650000000.0)
+        records = [iperf_analyzer.TCPGEN_RECORD.pack(i * 0.1, (i + 1) * 0.1, 125000, 12500000, 12000000,
+                                                     144800, 40000, 100, 0, 1000, 0) for i in range(10)]
+        self.offload({'hs1_tcpgen.bin': header + b''.join(records)})
+        self.assertEqual(os.listdir(os.path.join(self.root, 'logs', EXPERIMENT)), ['hs1_tcpgen.bin.gz'])
+        iperf_analyzer.extract_save_send_log([EXPERIMENT])
+        send = self.read_csv(iperf_analyzer.send_log_file)
+        self.assertEqual(len(send), 10)
+        self.assertEqual(send[0]['host'], 'hs1_tcpgen.bin')
+        self.assertAlmostEqual(float(send[0]['bits_per_second']), 1e7)
+        self.assertEqual(int(send[-1]['cpu_us']), 1000)
+
+    def test_offloaded_video_log(self):
+        header = iperf_analyzer.TCPGEN_HEADER.pack(b'TGEN', 1, video_analyzer.CHUNK_RECORD.size, 4, 1650000000.0)
+        records = [video_analyzer.CHUNK_RECORD.pack(i * 2.0, 0.5, 4.0, 0.0, 625000, 2500, 0) for i in range(5)]
+        self.offload({'hr1_video.bin': header + b''.join(records),
+                      'metadata.json': json.dumps({'cctypes': ['bbr'],
+                                                   'hosts': [{'sender': 'hs1', 'receiver': 'hr1', 'cctype': 'bbr'}]})})
+        video_analyzer.extract_save_video([EXPERIMENT])
+        segments = self.read_csv(video_analyzer.video_file)
+        summary = self.read_csv(video_analyzer.video_summary_file)
+        self.assertEqual(len(segments), 5)
+        self.assertEqual(segments[0]['host'], 'hr1_video.bin')
+        self.assertEqual(summary[0]['cctype'], 'bbr')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,526 @@
+/*
+ * crossgen: background cross traffic for the s1-s2 bottleneck.
+ *
+ * The tested flows are greedy and responsive. Real links also carry bursty
+ * traffic that does not back off, and many short flows. crossgen sends a mix of
+ *
+ *   UDP, unresponsive: a packet trace replayed with its sizes and timing
+ *        (-T file, lines "<secs> <bytes>", e.g. from
+ *        tshark -T fields -e frame.time_relative -e frame.len, sent as UDP
+ *        payloads of <bytes> less the Ethernet, IPv4 and UDP headers so the
+ *        frames on the wire keep the traced size), looped until the end of
+ *        the run, or a Pareto on/off source sending at -u Mbps
+ *        while on (-n mean on secs, -f mean off secs, -a shape)
+ *   TCP, responsive: flows arriving as a Poisson process (-F flows/sec) with
+ *        Pareto sizes (-z mean bytes, same shape), each on a new connection
+ *
+ * to a sink (-s) that discards everything. UDP packets carry a sequence number
+ * so the sink counts the lost ones. Both sides write one line per interval:
+ *
+ *   # <unix time of the first interval start>
+ *   start end udp_bytes udp_pkts udp_lost tcp_bytes flows_started flows_done
+ *
+ * (the sender leaves udp_lost 0, the sink leaves flows_started 0).
+ *
+ * Usage:
+ *   crossgen -s [-p port] [-i secs] -o file
+ *   crossgen -c host [-p port] [-i secs] [-t secs] [-T trace | -u mbps
+ *            [-n on] [-f off]] [-F flows/sec -z bytes] [-a shape] [-l size]
+ *            [-C cc] [-S seed] -o file
+ *
+ * Build: gcc -O2 -Wall -o tools/crossgen tools/crossgen.c -lm
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FLOWS	256	/* concurrent TCP flows, more arrivals wait */
+#define MAX_PACKET	65507
+#define CHUNK		65536
+/* Ethernet, IPv4 and UDP headers in a traced frame.len, not sent as payload */
+#define TRACE_HEADERS	(14 + 20 + 8)
+
+struct options {
+	int	sink;
+	const char *host;
+	const char *port;
+	const char *cc;
+	const char *trace;
+	const char *output;
+	double	interval;
+	double	duration;
+	double	udp_rate;	/* bits/sec while on */
+	double	mean_on;	/* secs */
+	double	mean_off;	/* secs */
+	double	shape;		/* Pareto shape of on/off times and sizes */
+	double	flow_rate;	/* TCP flow arrivals per sec */
+	double	flow_size;	/* mean bytes of a TCP flow */
+	int	packet;		/* UDP payload bytes of the on/off source */
+	unsigned int seed;
+};
+
+struct interval {
+	FILE	*f;
+	double	start;		/* monotonic secs of the first interval */
+	double	last;
+	uint64_t udp_bytes;
+	uint64_t udp_pkts;
+	uint64_t udp_lost;
+	uint64_t tcp_bytes;
+	uint32_t started;
+	uint32_t done;
+};
+
+struct packet {
+	double	at;		/* secs from trace start */
+	int	size;
+};
+
+struct flow {
+	int	fd;
+	uint64_t left;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: crossgen -s [-p port] [-i secs] -o file\n"
+		"       crossgen -c host [-p port] [-i secs] [-t secs] [-T trace | -u mbps [-n on] [-f off]]"
+		" [-F flows/sec -z bytes] [-a shape] [-l size] [-C cc] [-S seed] -o file\n");
+	exit(2);
+}
+
+static double uniform(void)
+{
+	return (random() + 1.0) / (RAND_MAX + 2.0);
+}
+
+/* Pareto sample with the given mean, shape > 1. */
+static double pareto(double mean, double shape)
+{
+	return mean * (shape - 1) / shape / pow(uniform(), 1 / shape);
+}
+
+static double exponential(double mean)
+{
+	return -mean * log(uniform());
+}
+
+static void interval_open(struct interval *iv, const char *output)
+{
+	struct timespec ts;
+
+	memset(iv, 0, sizeof(*iv));
+	iv->f = fopen(output, "w");
+	if (!iv->f)
+		die("fopen");
+	clock_gettime(CLOCK_REALTIME, &ts);
+	fprintf(iv->f, "# %.6f\n", ts.tv_sec + ts.tv_nsec / 1e9);
+	iv->start = iv->last = now();
+}
+
+static void interval_write(struct interval *iv, double t)
+{
+	fprintf(iv->f, "%.6f %.6f %llu %llu %llu %llu %u %u\n",
+		iv->last - iv->start, t - iv->start,
+		(unsigned long long)iv->udp_bytes,
+		(unsigned long long)iv->udp_pkts,
+		(unsigned long long)iv->udp_lost,
+		(unsigned long long)iv->tcp_bytes, iv->started, iv->done);
+	fflush(iv->f);
+	iv->last = t;
+	iv->udp_bytes = iv->udp_pkts = iv->udp_lost = iv->tcp_bytes = 0;
+	iv->started = iv->done = 0;
+}
+
+static struct addrinfo *resolve(const char *host, const char *port, int type)
+{
+	struct addrinfo hints, *res;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = type;
+	hints.ai_flags = host ? 0 : AI_PASSIVE;
+	err = getaddrinfo(host, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		exit(1);
+	}
+	return res;
+}
+
+static struct packet *load_trace(const char *filename, int *count)
+{
+	struct packet *pkts = NULL;
+	double at, first = -1;
+	int size, n = 0, cap = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f)
+		die("fopen trace");
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lf %d", &at, &size) != 2 || size <= 0)
+			continue;
+		if (first < 0)
+			first = at;
+		if (n == cap) {
+			cap = cap ? cap * 2 : 4096;
+			pkts = realloc(pkts, cap * sizeof(*pkts));
+			if (!pkts)
+				die("realloc");
+		}
+		pkts[n].at = at - first;
+		/* room for the sequence number at least */
+		size -= TRACE_HEADERS;
+		if (size < (int)sizeof(uint64_t))
+			size = sizeof(uint64_t);
+		pkts[n].size = size < MAX_PACKET ? size : MAX_PACKET;
+		n++;
+	}
+	fclose(f);
+	if (!n) {
+		fprintf(stderr, "crossgen: no packets in %s\n", filename);
+		exit(1);
+	}
+	*count = n;
+	return pkts;
+}
+
+static int open_flow(const struct addrinfo *res, const char *cc)
+{
+	int fd;
+
+	fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		die("socket");
+	if (cc && setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, cc, strlen(cc)))
+		die("setsockopt TCP_CONGESTION");
+	if (connect(fd, res->ai_addr, res->ai_addrlen) && errno != EINPROGRESS)
+		die("connect");
+	return fd;
+}
+
+static int run_sender(const struct options *opt)
+{
+	struct addrinfo *udp_res = resolve(opt->host, opt->port, SOCK_DGRAM);
+	struct addrinfo *tcp_res = resolve(opt->host, opt->port, SOCK_STREAM);
+	struct flow flows[MAX_FLOWS];
+	struct pollfd pfds[MAX_FLOWS];
+	struct packet *trace = NULL;
+	struct interval iv;
+	struct timespec timeout;
+	double t, deadline, next_stat, next_pkt, on_until, loop_start = 0;
+	double next_flow, wait;
+	int udp, nflows = 0, queued = 0, trace_len = 0, idx = 0, i, size;
+	uint64_t seq = 0;
+	static char buf[CHUNK];
+	ssize_t n;
+
+	srandom(opt->seed);
+	udp = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp < 0)
+		die("socket");
+	if (opt->trace)
+		trace = load_trace(opt->trace, &trace_len);
+
+	interval_open(&iv, opt->output);
+	t = iv.start;
+	deadline = t + opt->duration;
+	next_stat = t + opt->interval;
+	/* first on period of the on/off source starts after an off period */
+	next_pkt = opt->trace ? t : opt->udp_rate > 0 ?
+		   t + pareto(opt->mean_off, opt->shape) : INFINITY;
+	on_until = next_pkt + pareto(opt->mean_on, opt->shape);
+	if (opt->trace)
+		loop_start = t;
+	next_flow = opt->flow_rate > 0 ? t + exponential(1 / opt->flow_rate) :
+		    INFINITY;
+
+	while (t < deadline) {
+		/* UDP packets due */
+		while (next_pkt <= t) {
+			size = opt->trace ? trace[idx].size : opt->packet;
+			memcpy(buf, &seq, sizeof(seq));
+			n = sendto(udp, buf, size, MSG_DONTWAIT,
+				   udp_res->ai_addr, udp_res->ai_addrlen);
+			if (n > 0) {
+				iv.udp_bytes += n;
+				iv.udp_pkts++;
+			}
+			seq++;	/* a local drop counts as lost too */
+			if (opt->trace) {
+				if (++idx == trace_len) {
+					/* loop, keeping the mean gap */
+					loop_start += trace[trace_len - 1].at +
+						trace[trace_len - 1].at /
+						trace_len;
+					idx = 0;
+				}
+				next_pkt = loop_start + trace[idx].at;
+			} else {
+				next_pkt += opt->packet * 8.0 / opt->udp_rate;
+				if (next_pkt > on_until) {
+					next_pkt = on_until +
+						pareto(opt->mean_off,
+						       opt->shape);
+					on_until = next_pkt +
+						pareto(opt->mean_on,
+						       opt->shape);
+				}
+			}
+		}
+		/* TCP flow arrivals */
+		while (next_flow <= t) {
+			queued++;
+			next_flow += exponential(1 / opt->flow_rate);
+		}
+		while (queued && nflows < MAX_FLOWS) {
+			flows[nflows].fd = open_flow(tcp_res, opt->cc);
+			flows[nflows].left =
+				(uint64_t)pareto(opt->flow_size, opt->shape) + 1;
+			nflows++;
+			queued--;
+			iv.started++;
+		}
+
+		for (i = 0; i < nflows; i++) {
+			pfds[i].fd = flows[i].fd;
+			pfds[i].events = POLLOUT;
+		}
+		wait = fmin(fmin(next_pkt, next_flow), fmin(next_stat, deadline))
+		       - t;
+		wait = wait > 0 ? wait : 0;
+		timeout.tv_sec = (time_t)wait;
+		timeout.tv_nsec = (long)((wait - timeout.tv_sec) * 1e9);
+		if (ppoll(pfds, nflows, &timeout, NULL) < 0 && errno != EINTR)
+			die("ppoll");
+
+		for (i = 0; i < nflows; i++) {
+			if (!pfds[i].revents)
+				continue;
+			n = send(flows[i].fd, buf,
+				 flows[i].left < CHUNK ? flows[i].left : CHUNK,
+				 MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (n < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if (n > 0) {
+				iv.tcp_bytes += n;
+				flows[i].left -= n;
+			}
+			if (n > 0 && flows[i].left)
+				continue;
+			/* done, or failed: the sink may not be up yet */
+			close(flows[i].fd);
+			if (n > 0)
+				iv.done++;
+			flows[i] = flows[--nflows];
+			pfds[i] = pfds[nflows];
+			i--;
+		}
+
+		t = now();
+		if (t >= next_stat) {
+			interval_write(&iv, t);
+			next_stat += opt->interval;
+		}
+	}
+	interval_write(&iv, t);
+	fclose(iv.f);
+	for (i = 0; i < nflows; i++)
+		close(flows[i].fd);
+	freeaddrinfo(udp_res);
+	freeaddrinfo(tcp_res);
+	free(trace);
+	return 0;
+}
+
+static int run_sink(const struct options *opt)
+{
+	struct addrinfo *udp_res = resolve(NULL, opt->port, SOCK_DGRAM);
+	struct addrinfo *tcp_res = resolve(NULL, opt->port, SOCK_STREAM);
+	struct pollfd pfds[MAX_FLOWS + 2];
+	struct interval iv;
+	uint64_t seq, next_seq = 0;
+	static char buf[CHUNK];
+	int npfds = 2, i, fd, one = 1, timeout;
+	double t, next_stat;
+	ssize_t n;
+
+	pfds[0].fd = socket(AF_INET, SOCK_DGRAM, 0);
+	pfds[1].fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (pfds[0].fd < 0 || pfds[1].fd < 0)
+		die("socket");
+	setsockopt(pfds[1].fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(pfds[0].fd, udp_res->ai_addr, udp_res->ai_addrlen) ||
+	    bind(pfds[1].fd, tcp_res->ai_addr, tcp_res->ai_addrlen) ||
+	    listen(pfds[1].fd, 128))
+		die("bind");
+	freeaddrinfo(udp_res);
+	freeaddrinfo(tcp_res);
+	pfds[0].events = pfds[1].events = POLLIN;
+
+	interval_open(&iv, opt->output);
+	next_stat = iv.start + opt->interval;
+	/* runs until killed, every interval is flushed */
+	for (;;) {
+		/* at MAX_FLOWS the pending connections wait in the backlog,
+		 * polling the listener would only spin
+		 */
+		pfds[1].events = npfds < MAX_FLOWS + 2 ? POLLIN : 0;
+		timeout = (int)((next_stat - now()) * 1000) + 1;
+		if (poll(pfds, npfds, timeout > 0 ? timeout : 0) < 0 &&
+		    errno != EINTR)
+			die("poll");
+		if (pfds[0].revents) {
+			while ((n = recv(pfds[0].fd, buf, sizeof(buf),
+					 MSG_DONTWAIT)) > 0) {
+				iv.udp_bytes += n;
+				iv.udp_pkts++;
+				if (n < (ssize_t)sizeof(seq))
+					continue;
+				memcpy(&seq, buf, sizeof(seq));
+				/* reordered packets are not expected */
+				if (seq > next_seq)
+					iv.udp_lost += seq - next_seq;
+				if (seq >= next_seq)
+					next_seq = seq + 1;
+			}
+		}
+		if (pfds[1].revents && npfds < MAX_FLOWS + 2) {
+			fd = accept4(pfds[1].fd, NULL, NULL, SOCK_NONBLOCK);
+			if (fd >= 0) {
+				pfds[npfds].fd = fd;
+				pfds[npfds].events = POLLIN;
+				pfds[npfds].revents = 0;
+				npfds++;
+			}
+		}
+		for (i = 2; i < npfds; i++) {
+			if (!pfds[i].revents)
+				continue;
+			n = recv(pfds[i].fd, buf, sizeof(buf), MSG_TRUNC);
+			if (n > 0) {
+				iv.tcp_bytes += n;
+				continue;
+			}
+			if (n < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			close(pfds[i].fd);
+			iv.done++;
+			pfds[i--] = pfds[--npfds];
+		}
+		t = now();
+		if (t >= next_stat) {
+			interval_write(&iv, t);
+			next_stat += opt->interval;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct options opt = {
+		.sink = -1,
+		.port = "5301",
+		.interval = 0.1,
+		.duration = 10,
+		.mean_on = 1,
+		.mean_off = 1,
+		.shape = 1.5,
+		.flow_size = 100000,
+		.packet = 1400,
+		.seed = 1,
+	};
+	int c;
+
+	while ((c = getopt(argc, argv, "sc:p:i:t:T:u:n:f:a:F:z:l:C:S:o:")) != -1) {
+		switch (c) {
+		case 's':
+			opt.sink = 1;
+			break;
+		case 'c':
+			opt.sink = 0;
+			opt.host = optarg;
+			break;
+		case 'p':
+			opt.port = optarg;
+			break;
+		case 'i':
+			opt.interval = atof(optarg);
+			break;
+		case 't':
+			opt.duration = atof(optarg);
+			break;
+		case 'T':
+			opt.trace = optarg;
+			break;
+		case 'u':
+			opt.udp_rate = atof(optarg) * 1e6;
+			break;
+		case 'n':
+			opt.mean_on = atof(optarg);
+			break;
+		case 'f':
+			opt.mean_off = atof(optarg);
+			break;
+		case 'a':
+			opt.shape = atof(optarg);
+			break;
+		case 'F':
+			opt.flow_rate = atof(optarg);
+			break;
+		case 'z':
+			opt.flow_size = atof(optarg);
+			break;
+		case 'l':
+			opt.packet = atoi(optarg);
+			break;
+		case 'C':
+			opt.cc = optarg;
+			break;
+		case 'S':
+			opt.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			opt.output = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (opt.sink < 0 || !opt.output || opt.interval <= 0 ||
+	    opt.shape <= 1 || opt.packet < (int)sizeof(uint64_t) ||
+	    opt.packet > MAX_PACKET)
+		usage();
+	return opt.sink ? run_sink(&opt) : run_sender(&opt);
+}
@@ -0,0 +1,836 @@
+/*
+ * tcpgen: bulk TCP sender/receiver for high rate experiments.
+ *
+ * iperf3 copies every byte through userspace on both sides and becomes CPU
+ * bound at multi-gigabit rates, so the results measure the sender CPU rather
+ * than the congestion control. tcpgen keeps the data path out of userspace:
+ *
+ *   sender:   sendfile() from a memfd (default), or send(MSG_ZEROCOPY) from
+ *             one pinned buffer, or plain send() for comparison
+ *   receiver: recv(MSG_TRUNC) discards the stream in the kernel, with a large
+ *             SO_RCVBUF and optional SO_BUSY_POLL
+ *
+ * The congestion control is set per socket with TCP_CONGESTION on both sides,
+ * so a receiver running e.g. bbr2_ecn sends its precise ECE acks.
+ *
+ * Every interval one fixed size binary record is written to the stats file,
+ * parsed by analyzer/iperf_analyzer.py:
+ *
+ *   header: char magic[4] "TGEN", u32 version, u32 record size,
+ *           u32 role, double unix time of the first interval start
+ *   record: struct tcpgen_record below, little endian
+ *
+ * Incast: responders (-r) wait for requests, an aggregator (-a) connects to
+ * all of them and repeatedly asks every responder for the same number of bytes
+ * at once, then records how long the slowest and the fastest response took
+ * (struct tcpgen_rct_record), parsed by analyzer/incast_analyzer.py.
+ *
+ * Streaming: a player (-v) asks a responder for video segments one by one,
+ * picking each bitrate from a ladder by recent download throughput and pausing
+ * while its playout buffer is full, so the sending socket goes idle and app
+ * limited the way video delivery does. Every segment is recorded
+ * (struct tcpgen_chunk_record) with the stall it caused, parsed by
+ * analyzer/video_analyzer.py. A sender with -R instead sends at a constant
+ * capped rate.
+ *
+ * Usage:
+ *   tcpgen -s [-p port] [-C cc] [-i secs] [-w rcvbuf] [-b busy_poll_us] -o file
+ *   tcpgen -c host [-p port] [-C cc] [-i secs] [-t secs]
+ *          [-m sendfile|zerocopy|copy] [-l chunk] [-R mbps] -o file
+ *   tcpgen -r [-p port] [-C cc] [-l chunk]
+ *   tcpgen -a host,host,... [-p port] [-C cc] [-n requests] [-q bytes]
+ *          [-g gap_secs] [-w rcvbuf] -o file
+ *   tcpgen -v host [-p port] [-C cc] [-t secs] [-d segment_secs]
+ *          [-L kbps,kbps,...] [-B buffer_secs] -o file
+ *
+ * Build: gcc -O2 -Wall -o tools/tcpgen tools/tcpgen.c
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/tcp.h>	/* tcp_info with pacing and delivery rate */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+#define TCPGEN_MAGIC	"TGEN"
+#define TCPGEN_VERSION	1
+#define DEFAULT_CHUNK	(256 * 1024)
+#define CONNECT_RETRY_MS 2000	/* the receiver may still be starting */
+#define MAX_LADDER	16
+#define ABR_SAMPLES	5	/* chunk throughputs the player averages */
+#define ABR_SAFETY	0.8	/* fraction of that estimate it dares to ask for */
+
+enum send_mode { MODE_SENDFILE, MODE_ZEROCOPY, MODE_COPY };
+enum role { ROLE_RECEIVER, ROLE_SENDER, ROLE_AGGREGATOR, ROLE_RESPONDER,
+	    ROLE_PLAYER };
+
+struct tcpgen_header {
+	char	magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t role;		/* enum role */
+	double	start_time;	/* unix time of the first interval start */
+} __attribute__((packed));
+
+struct tcpgen_record {
+	double	start;		/* secs since the first interval start */
+	double	end;
+	uint64_t bytes;		/* sent (or received) in this interval */
+	uint64_t pacing_rate;	/* bytes/sec, tcpi_pacing_rate */
+	uint64_t delivery_rate;	/* bytes/sec, tcpi_delivery_rate */
+	uint32_t snd_cwnd;	/* bytes, like iperf3 */
+	uint32_t rtt;		/* usecs */
+	uint32_t rttvar;	/* usecs */
+	uint32_t retransmits;	/* retransmitted packets in this interval */
+	uint32_t cpu_us;	/* user + sys cpu time of this process */
+	uint32_t unused;
+} __attribute__((packed));
+
+/* One incast request, written by the aggregator. */
+struct tcpgen_rct_record {
+	double	start;		/* secs since start, when the request was sent */
+	double	rct;		/* secs until the slowest response completed */
+	double	first;		/* secs until the fastest response completed */
+	uint64_t bytes;		/* of all responses */
+	uint32_t flows;		/* responders asked */
+	uint32_t unused;
+} __attribute__((packed));
+
+/* One video segment, written by the player. */
+struct tcpgen_chunk_record {
+	double	start;		/* secs since start, when the segment was asked */
+	double	download;	/* secs until it was received */
+	double	buffer;		/* secs of video buffered when it was asked */
+	double	stall;		/* secs playback was frozen waiting for it */
+	uint64_t bytes;
+	uint32_t bitrate;	/* kbps */
+	uint32_t unused;
+} __attribute__((packed));
+
+struct options {
+	int	role;
+	const char *host;
+	const char *port;
+	const char *cc;
+	const char *output;
+	double	interval;
+	double	duration;
+	enum send_mode mode;
+	size_t	chunk;
+	int	rcvbuf;
+	int	busy_poll;
+	int	requests;	/* incast requests of the aggregator */
+	uint64_t response;	/* bytes asked from every responder */
+	double	gap;		/* secs between incast requests */
+	double	rate;		/* bytes/sec cap of the sender, 0 is greedy */
+	double	segment;	/* secs of video in one segment */
+	double	max_buffer;	/* secs the player buffers at most */
+	int	ladder_len;
+	uint32_t ladder[MAX_LADDER];	/* kbps, ascending */
+};
+
+struct stats {
+	FILE	*f;
+	double	start;		/* monotonic secs */
+	double	last;		/* start of the current interval */
+	uint64_t bytes;
+	uint32_t retrans;	/* tcpi_total_retrans at interval start */
+	uint64_t cpu;		/* process cpu usecs at interval start */
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t cpu_usecs(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+	       ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: tcpgen -s [-p port] [-C cc] [-i secs] [-w rcvbuf] [-b busy_poll_us] -o file\n"
+		"       tcpgen -c host [-p port] [-C cc] [-i secs] [-t secs] [-m sendfile|zerocopy|copy]"
+		" [-l chunk] -o file\n"
+		"       tcpgen -r [-p port] [-C cc] [-l chunk]\n"
+		"       tcpgen -a host,host,... [-p port] [-C cc] [-n requests] [-q bytes] [-g gap_secs]"
+		" [-w rcvbuf] -o file\n"
+		"       tcpgen -v host [-p port] [-C cc] [-t secs] [-d segment_secs] [-L kbps,kbps,...]"
+		" [-B buffer_secs] -o file\n");
+	exit(2);
+}
+
+static void stats_open(struct stats *st, const struct options *opt)
+{
+	struct tcpgen_header hdr;
+	struct timespec ts;
+
+	memset(st, 0, sizeof(*st));
+	st->f = fopen(opt->output, "wb");
+	if (!st->f)
+		die("fopen");
+	clock_gettime(CLOCK_REALTIME, &ts);
+	memcpy(hdr.magic, TCPGEN_MAGIC, 4);
+	hdr.version = TCPGEN_VERSION;
+	hdr.record_size = opt->role == ROLE_AGGREGATOR ?
+			  sizeof(struct tcpgen_rct_record) :
+			  opt->role == ROLE_PLAYER ?
+			  sizeof(struct tcpgen_chunk_record) :
+			  sizeof(struct tcpgen_record);
+	hdr.role = opt->role;
+	hdr.start_time = ts.tv_sec + ts.tv_nsec / 1e9;
+	fwrite(&hdr, sizeof(hdr), 1, st->f);
+	fflush(st->f);
+	st->start = st->last = now();
+	st->cpu = cpu_usecs();
+}
+
+/* Close the current interval at time t and write its record. */
+static void stats_record(struct stats *st, int fd, double t)
+{
+	struct tcpgen_record rec;
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+	uint64_t cpu = cpu_usecs();
+
+	memset(&rec, 0, sizeof(rec));
+	memset(&info, 0, sizeof(info));
+	getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+	rec.start = st->last - st->start;
+	rec.end = t - st->start;
+	rec.bytes = st->bytes;
+	rec.pacing_rate = info.tcpi_pacing_rate;
+	rec.delivery_rate = info.tcpi_delivery_rate;
+	rec.snd_cwnd = info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+	rec.rtt = info.tcpi_rtt;
+	rec.rttvar = info.tcpi_rttvar;
+	rec.retransmits = info.tcpi_total_retrans - st->retrans;
+	rec.cpu_us = cpu - st->cpu;
+	fwrite(&rec, sizeof(rec), 1, st->f);
+	fflush(st->f);
+
+	st->last = t;
+	st->bytes = 0;
+	st->retrans = info.tcpi_total_retrans;
+	st->cpu = cpu;
+}
+
+static void set_cc(int fd, const char *cc)
+{
+	if (cc && setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, cc, strlen(cc)))
+		die("setsockopt TCP_CONGESTION");
+}
+
+static struct addrinfo *resolve(const char *host, const char *port)
+{
+	struct addrinfo hints, *res;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = host ? 0 : AI_PASSIVE;
+	err = getaddrinfo(host, port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+		exit(1);
+	}
+	return res;
+}
+
+/* Connect to host, retrying while the other side is not listening yet. */
+static int connect_to(const char *host, const char *port, const char *cc,
+		      int zerocopy)
+{
+	struct addrinfo *res = resolve(host, port);
+	double deadline;
+	int fd, one = 1;
+
+	fd = socket(res->ai_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	set_cc(fd, cc);
+	if (zerocopy &&
+	    setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)))
+		die("setsockopt SO_ZEROCOPY");
+	deadline = now() + CONNECT_RETRY_MS / 1000.0;
+	while (connect(fd, res->ai_addr, res->ai_addrlen)) {
+		if (errno != ECONNREFUSED || now() > deadline)
+			die("connect");
+		usleep(10000);
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/* Accept one connection on port. The accepted socket inherits the congestion
+ * control and receive buffer of the listener.
+ */
+static int accept_one(const struct options *opt)
+{
+	struct addrinfo *res = resolve(NULL, opt->port);
+	int lfd, fd, one = 1;
+
+	lfd = socket(res->ai_family, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	set_cc(lfd, opt->cc);
+	if (opt->rcvbuf &&
+	    setsockopt(lfd, SOL_SOCKET, SO_RCVBUF, &opt->rcvbuf,
+		       sizeof(opt->rcvbuf)))
+		die("setsockopt SO_RCVBUF");
+	if (bind(lfd, res->ai_addr, res->ai_addrlen) || listen(lfd, 1))
+		die("bind");
+	freeaddrinfo(res);
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		die("accept");
+	close(lfd);
+	return fd;
+}
+
+/* Drain MSG_ZEROCOPY completions, so pinned pages and optmem are released.
+ * Returns how many sends the kernel had to copy anyway (e.g. when the skb is
+ * looped back to a local receiver).
+ */
+static uint64_t reap_completions(int fd)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct sock_extended_err *serr;
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	uint64_t copied = 0;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				copied += serr->ee_data - serr->ee_info + 1;
+		}
+	}
+	return copied;
+}
+
+/* A memfd of chunk bytes to sendfile() from, its pages stay in memory. */
+static int source_file(size_t chunk)
+{
+	char *buf;
+	int fd;
+
+	fd = memfd_create("tcpgen", 0);
+	if (fd < 0)
+		die("memfd_create");
+	buf = calloc(1, chunk);
+	if (!buf || write(fd, buf, chunk) != (ssize_t)chunk)
+		die("write memfd");
+	free(buf);
+	return fd;
+}
+
+static int run_sender(const struct options *opt)
+{
+	struct stats st;
+	uint64_t copied = 0, sent = 0;
+	double t, deadline, next;
+	char *buf = NULL;
+	int fd, src = -1;
+	off_t off;
+	ssize_t n;
+
+	fd = connect_to(opt->host, opt->port, opt->cc,
+			opt->mode == MODE_ZEROCOPY);
+
+	if (opt->mode == MODE_SENDFILE) {
+		src = source_file(opt->chunk);
+	} else {
+		buf = mmap(NULL, opt->chunk, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (buf == MAP_FAILED)
+			die("mmap");
+	}
+
+	stats_open(&st, opt);
+	deadline = st.start + opt->duration;
+	next = st.start + opt->interval;
+	for (;;) {
+		/* capped: wait until this chunk is within the rate since start */
+		if (opt->rate) {
+			t = (sent + opt->chunk) / opt->rate - (now() - st.start);
+			if (t > 0)
+				usleep(t * 1e6);
+		}
+		switch (opt->mode) {
+		case MODE_SENDFILE:
+			off = 0;
+			n = sendfile(fd, src, &off, opt->chunk);
+			break;
+		case MODE_ZEROCOPY:
+			n = send(fd, buf, opt->chunk, MSG_ZEROCOPY);
+			/* optmem for notifications is full, wait for some */
+			if (n < 0 && errno == ENOBUFS) {
+				copied += reap_completions(fd);
+				usleep(100);
+				continue;
+			}
+			copied += reap_completions(fd);
+			break;
+		default:
+			n = send(fd, buf, opt->chunk, 0);
+		}
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("send");
+		}
+		st.bytes += n;
+		sent += n;
+		t = now();
+		/* an idle capped sender still closes its intervals */
+		while (t >= next) {
+			stats_record(&st, fd, t);
+			next += opt->interval;
+		}
+		if (t >= deadline)
+			break;
+	}
+	if (opt->mode == MODE_ZEROCOPY && copied)
+		fprintf(stderr, "tcpgen: %llu zerocopy sends were copied\n",
+			(unsigned long long)copied);
+	fclose(st.f);
+	close(fd);
+	return 0;
+}
+
+static int run_receiver(const struct options *opt)
+{
+	struct stats st;
+	double t, next;
+	char *buf;
+	int fd;
+	ssize_t n;
+
+	fd = accept_one(opt);
+	if (opt->busy_poll &&
+	    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opt->busy_poll,
+		       sizeof(opt->busy_poll)))
+		perror("setsockopt SO_BUSY_POLL");
+
+	/* MSG_TRUNC discards the data in the kernel, buf is never written */
+	buf = malloc(opt->chunk);
+	if (!buf)
+		die("malloc");
+	stats_open(&st, opt);
+	next = st.start + opt->interval;
+	for (;;) {
+		n = recv(fd, buf, opt->chunk, MSG_TRUNC);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("recv");
+		}
+		t = now();
+		st.bytes += n;
+		if (t >= next || !n) {
+			stats_record(&st, fd, t);
+			next += opt->interval;
+		}
+		if (!n)
+			break;
+	}
+	fclose(st.f);
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+/* Serve incast requests: each one is the number of bytes to send back. */
+static int run_responder(const struct options *opt)
+{
+	uint64_t request, left;
+	int fd, src;
+	off_t off;
+	ssize_t n;
+
+	fd = accept_one(opt);
+	src = source_file(opt->chunk);
+	while ((n = recv(fd, &request, sizeof(request), MSG_WAITALL)) ==
+	       sizeof(request)) {
+		for (left = request; left; left -= n) {
+			off = 0;
+			n = sendfile(fd, src, &off,
+				     left < opt->chunk ? left : opt->chunk);
+			if (n < 0 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			if (n <= 0)
+				die("sendfile");
+		}
+	}
+	close(src);
+	close(fd);
+	return 0;
+}
+
+/* Ask every responder for opt->response bytes at once, opt->requests times,
+ * and record the completion time of each request.
+ */
+static int run_aggregator(const struct options *opt)
+{
+	struct tcpgen_rct_record rec;
+	struct stats st;
+	struct pollfd *pfds;
+	uint64_t *left;
+	char *hosts, *host, *saveptr, *buf;
+	double t0, t;
+	int i, r, flows = 0, pending;
+	ssize_t n;
+
+	hosts = strdup(opt->host);
+	for (host = hosts, i = 1; *host; host++)
+		i += *host == ',';
+	pfds = calloc(i, sizeof(*pfds));
+	left = calloc(i, sizeof(*left));
+	buf = malloc(opt->chunk);
+	if (!hosts || !pfds || !left || !buf)
+		die("malloc");
+	for (host = strtok_r(hosts, ",", &saveptr); host;
+	     host = strtok_r(NULL, ",", &saveptr)) {
+		pfds[flows].fd = connect_to(host, opt->port, opt->cc, 0);
+		if (opt->rcvbuf)
+			setsockopt(pfds[flows].fd, SOL_SOCKET, SO_RCVBUF,
+				   &opt->rcvbuf, sizeof(opt->rcvbuf));
+		flows++;
+	}
+
+	stats_open(&st, opt);
+	for (r = 0; r < opt->requests; r++) {
+		memset(&rec, 0, sizeof(rec));
+		t0 = now();
+		for (i = 0; i < flows; i++) {
+			if (send(pfds[i].fd, &opt->response,
+				 sizeof(opt->response), 0) < 0)
+				die("send");
+			left[i] = opt->response;
+			pfds[i].events = POLLIN;
+		}
+		for (pending = flows; pending;) {
+			if (poll(pfds, flows, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				die("poll");
+			}
+			for (i = 0; i < flows; i++) {
+				if (!(pfds[i].revents & (POLLIN | POLLHUP |
+							 POLLERR)))
+					continue;
+				n = recv(pfds[i].fd, buf,
+					 left[i] < opt->chunk ?
+					 left[i] : opt->chunk,
+					 MSG_TRUNC | MSG_DONTWAIT);
+				if (n < 0 && (errno == EAGAIN ||
+					      errno == EINTR))
+					continue;
+				if (n <= 0)
+					die("recv");
+				left[i] -= n;
+				if (left[i])
+					continue;
+				/* response complete, stop polling it */
+				pfds[i].events = 0;
+				t = now() - t0;
+				if (!rec.first)
+					rec.first = t;
+				rec.rct = t;
+				pending--;
+			}
+		}
+		rec.start = t0 - st.start;
+		rec.bytes = opt->response * flows;
+		rec.flows = flows;
+		/* the testbed stops the aggregator with timeout(1), keep
+		 * every finished request on disk
+		 */
+		fwrite(&rec, sizeof(rec), 1, st.f);
+		fflush(st.f);
+		if (opt->gap > 0)
+			usleep(opt->gap * 1e6);
+	}
+	fclose(st.f);
+	for (i = 0; i < flows; i++)
+		close(pfds[i].fd);
+	free(hosts);
+	free(pfds);
+	free(left);
+	free(buf);
+	return 0;
+}
+
+/* Highest rung of the ladder within the safe share of the harmonic mean of
+ * the recent throughputs (bits/sec), the lowest one without samples.
+ */
+static uint32_t pick_bitrate(const struct options *opt, const double *samples,
+			     int count)
+{
+	double sum = 0, estimate;
+	int i, n = count < ABR_SAMPLES ? count : ABR_SAMPLES;
+
+	if (!n)
+		return opt->ladder[0];
+	for (i = 0; i < n; i++)
+		sum += 1 / samples[(count - 1 - i) % ABR_SAMPLES];
+	estimate = n / sum * ABR_SAFETY / 1000;
+	for (i = opt->ladder_len - 1; i > 0; i--)
+		if (opt->ladder[i] <= estimate)
+			break;
+	return opt->ladder[i];
+}
+
+/* Play a video for opt->duration secs from a responder: ask for one segment at
+ * a time, drain the playout buffer in real time and wait while it is full.
+ */
+static int run_player(const struct options *opt)
+{
+	struct tcpgen_chunk_record rec;
+	double samples[ABR_SAMPLES];
+	double buffer = 0, t0, t, wait, deadline;
+	uint64_t want, left;
+	struct stats st;
+	int fd, count = 0;
+	char *buf;
+	ssize_t n;
+
+	fd = connect_to(opt->host, opt->port, opt->cc, 0);
+	buf = malloc(opt->chunk);
+	if (!buf)
+		die("malloc");
+	stats_open(&st, opt);
+	deadline = st.start + opt->duration;
+	t = st.start;
+	while (t < deadline) {
+		/* buffer full: pause until there is room for one segment */
+		wait = buffer + opt->segment - opt->max_buffer;
+		if (wait > 0) {
+			usleep(wait * 1e6);
+			buffer -= wait;
+		}
+		memset(&rec, 0, sizeof(rec));
+		rec.bitrate = pick_bitrate(opt, samples, count);
+		want = (uint64_t)(rec.bitrate * 1000.0 / 8 * opt->segment);
+		t0 = now();
+		if (send(fd, &want, sizeof(want), 0) < 0)
+			die("send");
+		for (left = want; left; left -= n) {
+			n = recv(fd, buf, left < opt->chunk ?
+				 left : opt->chunk, MSG_TRUNC);
+			if (n < 0 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			if (n <= 0)
+				die("recv");
+		}
+		t = now();
+		rec.start = t0 - st.start;
+		rec.download = t - t0;
+		rec.buffer = buffer;
+		rec.bytes = want;
+		/* playback starts with the first segment, which is the
+		 * startup delay
+		 */
+		if (!count || rec.download > buffer)
+			rec.stall = rec.download - buffer;
+		buffer = buffer > rec.download ? buffer - rec.download : 0;
+		buffer += opt->segment;
+		samples[count++ % ABR_SAMPLES] = want * 8 / rec.download;
+		fwrite(&rec, sizeof(rec), 1, st.f);
+		fflush(st.f);
+	}
+	fclose(st.f);
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+static int parse_ladder(struct options *opt, char *arg)
+{
+	char *rung, *saveptr;
+
+	opt->ladder_len = 0;
+	for (rung = strtok_r(arg, ",", &saveptr); rung;
+	     rung = strtok_r(NULL, ",", &saveptr)) {
+		if (opt->ladder_len == MAX_LADDER)
+			return -1;
+		opt->ladder[opt->ladder_len] = strtoul(rung, NULL, 0);
+		if (!opt->ladder[opt->ladder_len] || (opt->ladder_len &&
+		    opt->ladder[opt->ladder_len] <=
+		    opt->ladder[opt->ladder_len - 1]))
+			return -1;
+		opt->ladder_len++;
+	}
+	return opt->ladder_len ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct options opt = {
+		.port = "5202",
+		.interval = 0.1,
+		.duration = 10,
+		.mode = MODE_SENDFILE,
+		.chunk = DEFAULT_CHUNK,
+		.role = -1,
+		.requests = 100,
+		.response = 64 * 1024,
+		.gap = 0.1,
+		.segment = 2,
+		.max_buffer = 12,
+		.ladder_len = 4,
+		.ladder = { 1000, 2500, 5000, 8000 },
+	};
+	int c;
+
+	while ((c = getopt(argc, argv, "sc:ra:v:p:C:i:t:m:l:w:b:n:q:g:R:d:L:B:o:")) != -1) {
+		switch (c) {
+		case 's':
+			opt.role = ROLE_RECEIVER;
+			break;
+		case 'c':
+			opt.role = ROLE_SENDER;
+			opt.host = optarg;
+			break;
+		case 'r':
+			opt.role = ROLE_RESPONDER;
+			break;
+		case 'a':
+			opt.role = ROLE_AGGREGATOR;
+			opt.host = optarg;
+			break;
+		case 'v':
+			opt.role = ROLE_PLAYER;
+			opt.host = optarg;
+			break;
+		case 'p':
+			opt.port = optarg;
+			break;
+		case 'C':
+			opt.cc = optarg;
+			break;
+		case 'i':
+			opt.interval = atof(optarg);
+			break;
+		case 't':
+			opt.duration = atof(optarg);
+			break;
+		case 'm':
+			if (!strcmp(optarg, "sendfile"))
+				opt.mode = MODE_SENDFILE;
+			else if (!strcmp(optarg, "zerocopy"))
+				opt.mode = MODE_ZEROCOPY;
+			else if (!strcmp(optarg, "copy"))
+				opt.mode = MODE_COPY;
+			else
+				usage();
+			break;
+		case 'l':
+			opt.chunk = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			opt.rcvbuf = atoi(optarg);
+			break;
+		case 'b':
+			opt.busy_poll = atoi(optarg);
+			break;
+		case 'n':
+			opt.requests = atoi(optarg);
+			break;
+		case 'q':
+			opt.response = strtoull(optarg, NULL, 0);
+			break;
+		case 'g':
+			opt.gap = atof(optarg);
+			break;
+		case 'R':
+			opt.rate = atof(optarg) * 1e6 / 8;
+			break;
+		case 'd':
+			opt.segment = atof(optarg);
+			break;
+		case 'L':
+			if (parse_ladder(&opt, optarg))
+				usage();
+			break;
+		case 'B':
+			opt.max_buffer = atof(optarg);
+			break;
+		case 'o':
+			opt.output = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (opt.role < 0 || opt.interval <= 0 || !opt.chunk ||
+	    opt.segment <= 0 || opt.max_buffer < opt.segment ||
+	    (!opt.output && opt.role != ROLE_RESPONDER))
+		usage();
+	switch (opt.role) {
+	case ROLE_SENDER:
+		return run_sender(&opt);
+	case ROLE_AGGREGATOR:
+		return run_aggregator(&opt);
+	case ROLE_RESPONDER:
+		return run_responder(&opt);
+	case ROLE_PLAYER:
+		return run_player(&opt);
+	default:
+		return run_receiver(&opt);
+	}
+}
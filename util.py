@@ -1,4 +1,13 @@
+import os
+import re
+import gzip
+import platform
 genericCC_PATH = '~/Desktop/genericCC'
+# built by run.sh
+TCPGEN_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tools', 'tcpgen')
+CROSSGEN_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tools', 'crossgen')
+# kernel module of each cc algorithm, its parameters are under /sys/module/<module>/parameters
+CC_MODULES = {'bbr': 'tcp_bbr', 'bbr2': 'tcp_bbr2', 'bbr2_ecn': 'tcp_bbr2', 'bbrplus': 'tcp_bbrplus'}
 
 def iperf_cmd(side="client",address="", interval=1, port=None, time=15, window_size=None, output_file="",
               verbose=True, json=True, algorithm=None):
@@ -44,6 +53,143 @@ def iperf_cmd(side="client",address="", interval=1, port=None, time=15, window_s
     
     return command + "&"
 
+def tcpgen_cmd(side="client", address="", port=None, time=15, interval=0.1, algorithm=None, output_file="",
+               mode="sendfile", rcvbuf=None, busy_poll=None, rate=None):
+    """command of tools/tcpgen, the in tree iperf3 replacement for high rates: the sender doesn't copy
+    data through userspace and the receiver discards it in the kernel. Stats are written every interval
+    into a binary output_file, parsed by analyzer/iperf_analyzer.py
+    Args:
+        side (str, optional): client(sender) or server(receiver). Defaults to client.
+        address (str, optional): Only for client side, the address of the receiver. Defaults to "".
+        port (int, optional): Defaults to None(5202).
+        time (int, optional): seconds to send, only for the sender. Defaults to 15.
+        interval (float, optional): seconds of one stats record. Defaults to 0.1.
+        algorithm (str, optional): tcp congestion control of the socket, set on both sides. Defaults to None(host default).
+        mode (str, optional): sender data path, 'sendfile', 'zerocopy'(MSG_ZEROCOPY) or 'copy'(plain send like iperf3).
+            Defaults to 'sendfile'. Between mininet hosts zerocopy sends are copied on delivery, sendfile is not.
+        rcvbuf (int, optional): receiver SO_RCVBUF in bytes, disables receive buffer autotuning. Defaults to None.
+        busy_poll (int, optional): receiver SO_BUSY_POLL in usecs. Defaults to None.
+        rate (float, optional): sender rate cap in Mbps, a constant rate stream instead of a bulk flow. Defaults to None.
+    """
+    command = f"{TCPGEN_PATH} "
+    if side == "server":
+        command += "-s "
+        if rcvbuf:
+            command += f"-w {rcvbuf} "
+        if busy_poll:
+            command += f"-b {busy_poll} "
+    else:
+        command += f"-c {address} -t {time} -m {mode} "
+        if rate:
+            # small writes keep the capped stream smooth
+            command += f"-R {rate} -l 16384 "
+    if port:
+        command += f"-p {port} "
+    if algorithm:
+        command += f"-C {algorithm} "
+    command += f"-i {interval} -o {output_file} "
+    return command + "&"
+
+def incast_cmd(side="responder", addresses=None, port=None, algorithm=None, requests=100, response_size=65536,
+               gap=0.1, output_file=""):
+    """command of a tools/tcpgen incast responder or aggregator. The aggregator connects to every responder and
+    asks all of them for response_size bytes at once, requests times with gap seconds in between, and records
+    the completion time of every request into a binary output_file, parsed by analyzer/incast_analyzer.py
+    Args:
+        side (str, optional): 'responder'(the senders) or 'aggregator'(the receiver). Defaults to responder.
+        addresses (list, optional): Only for aggregator, responder addresses. Defaults to None.
+        port (int, optional): Defaults to None(5202).
+        algorithm (str, optional): tcp congestion control of the sockets. Defaults to None(host default).
+        requests (int, optional): Defaults to 100.
+        response_size (int, optional): bytes of one response. Defaults to 65536.
+        gap (float, optional): seconds between two requests. Defaults to 0.1.
+    Returns:
+        str: the responder runs in background, the aggregator in foreground until the last request
+    """
+    command = f"{TCPGEN_PATH} "
+    if side == "responder":
+        command += "-r "
+    else:
+        command += f"-a {','.join(addresses)} -n {requests} -q {response_size} -g {gap} -o {output_file} "
+    if port:
+        command += f"-p {port} "
+    if algorithm:
+        command += f"-C {algorithm} "
+    return command + ("&" if side == "responder" else "")
+
+def video_cmd(side="client", address="", port=None, time=15, algorithm=None, segment=2, ladder=None, max_buffer=12,
+              output_file=""):
+    """command of a tools/tcpgen video player or the server it streams from. The player asks for one segment
+    at a time, picks its bitrate from the ladder by the recent download throughput and pauses while its buffer
+    is full, so the server socket is idle and app limited between segments. Every segment with its download
+    time and stall is recorded into a binary output_file, parsed by analyzer/video_analyzer.py
+    Args:
+        side (str, optional): client(the player, on the receiver) or server(on the sender). Defaults to client.
+        address (str, optional): Only for client, the server address. Defaults to "".
+        port (int, optional): Defaults to None(5202).
+        time (int, optional): Only for client, seconds to play. Defaults to 15.
+        algorithm (str, optional): tcp congestion control of the socket. Defaults to None(host default).
+        segment (float, optional): seconds of video in one segment. Defaults to 2.
+        ladder (list, optional): bitrates in kbps, ascending. Defaults to None([1000, 2500, 5000, 8000]).
+        max_buffer (float, optional): seconds of video the player buffers at most. Defaults to 12.
+    Returns:
+        str: runs in background
+    """
+    if side == "server":
+        return incast_cmd(side="responder", port=port, algorithm=algorithm)
+    command = f"{TCPGEN_PATH} -v {address} -t {time} -d {segment} -B {max_buffer} "
+    if ladder:
+        command += f"-L {','.join(map(str, ladder))} "
+    if port:
+        command += f"-p {port} "
+    if algorithm:
+        command += f"-C {algorithm} "
+    return command + f"-o {output_file} &"
+
+def crossgen_cmd(side="sender", address="", port=None, time=15, interval=0.1, trace=None, udp_rate=None,
+                 mean_on=1, mean_off=1, flow_rate=None, flow_size=100000, shape=1.5, algorithm=None, seed=None,
+                 output_file=""):
+    """command of tools/crossgen, background cross traffic through the bottleneck. The sender mixes unresponsive
+    UDP(a replayed packet trace or a Pareto on/off source) with Poisson arrivals of Pareto sized TCP flows,
+    the sink discards it and counts lost UDP packets. Both write per interval counters to output_file,
+    parsed by analyzer/cross_analyzer.py
+    Args:
+        side (str, optional): 'sender' or 'sink'. Defaults to sender.
+        address (str, optional): Only for sender, sink address. Defaults to "".
+        port (int, optional): UDP and TCP port. Defaults to None(5301).
+        time (int, optional): Only for sender, seconds to send. Defaults to 15.
+        interval (float, optional): seconds between two log lines. Defaults to 0.1.
+        trace (str, optional): replay a '<secs> <bytes>' per packet trace file in a loop. Defaults to None.
+        udp_rate (float, optional): Mbps of the UDP on/off source while on, ignored with trace. Defaults to None(no UDP).
+        mean_on (float, optional): mean seconds of an on period. Defaults to 1.
+        mean_off (float, optional): mean seconds of an off period. Defaults to 1.
+        flow_rate (float, optional): TCP flow arrivals per second. Defaults to None(no TCP).
+        flow_size (int, optional): mean bytes of a TCP flow. Defaults to 100000.
+        shape (float, optional): Pareto shape of on/off periods and flow sizes, > 1. Defaults to 1.5.
+        algorithm (str, optional): tcp congestion control of the TCP flows. Defaults to None(host default).
+        seed (int, optional): random seed, the same seed gives the same arrivals. Defaults to None(1).
+    Returns:
+        str: runs in background
+    """
+    command = f"{CROSSGEN_PATH} -i {interval} "
+    if side == "sink":
+        command += "-s "
+    else:
+        command += f"-c {address} -t {time} -a {shape} "
+        if trace:
+            command += f"-T {trace} "
+        elif udp_rate:
+            command += f"-u {udp_rate} -n {mean_on} -f {mean_off} "
+        if flow_rate:
+            command += f"-F {flow_rate} -z {flow_size} "
+        if algorithm:
+            command += f"-C {algorithm} "
+        if seed is not None:
+            command += f"-S {seed} "
+    if port:
+        command += f"-p {port} "
+    return command + f"-o {output_file} &"
+
 def copa_sender_cmd(serverip="", offduration=0, onduration=10000, 
                     cctype="markovian", delta="0.5",
                     num_cycles=1, output_file=""
@@ -82,6 +228,143 @@ def copa_sender_cmd(serverip="", offduration=0, onduration=10000,
         command += f'> {output_file} 2>&1 '
     return command + "&"
 
+def ss_sample_cmd(interval=0.05, count=100, port=5201, output_file=""):
+    """sample the tcp_info(cwnd, pacing rate, bbr pacing_gain...) of the iperf sockets on a host with ss(either
+    end on the port, so a socket accepted by a tcpgen responder is sampled too),
+    every sample starts with a line '# <epoch time>'
+
+    Args:
+        interval (float, optional): seconds between two samples. Defaults to 0.05.
+        count (int, optional): num of samples. Defaults to 100.
+        port (int, optional): iperf server port. Defaults to 5201.
+        output_file (str, optional): the file save the samples. Defaults to "".
+    """
+    command = f'for i in $(seq {count}); do echo "# $(date +%s.%N)"; ss -tin state established "( dport = :{port} or sport = :{port} )"; sleep {interval}; done '
+    if output_file:
+        command += f'> {output_file} 2>&1 '
+    return command + "&"
+
+def qdisc_sample_cmd(dev, interval=0.05, count=100, output_file=""):
+    """sample the qdisc backlog of a switch interface with tc, samples are formatted like ss_sample_cmd"""
+    command = f'for i in $(seq {count}); do echo "# $(date +%s.%N)"; tc -s qdisc show dev {dev}; sleep {interval}; done '
+    if output_file:
+        command += f'> {output_file} 2>&1 '
+    return command + "&"
+
+def netem_change_cmd(dev, delay, loss=0, jitter=None, parent="5:1"):
+    """change the netem qdisc mininet TCLink put on dev in place, e.g. to step the delay during a run.
+    netem resets every option not given, so loss and jitter of the link must be passed again
+
+    Args:
+        dev (str): interface, e.g. 's1-eth1'
+        delay (str): new delay (e.g. '50ms')
+        loss (int, optional): loss in percent. Defaults to 0.
+        jitter (str, optional): jitter (e.g. '1ms'). Defaults to None.
+        parent (str, optional): parent of the netem qdisc, '5:1' under the htb of a rate limited link,
+            None if the link has no bw limit and netem is the root. Defaults to "5:1".
+    """
+    command = f'tc qdisc change dev {dev} ' + (f'parent {parent} ' if parent else 'root ') + f'handle 10: netem delay {delay} '
+    if jitter:
+        command += f'{jitter} '
+    if loss:
+        command += f'loss {loss:.5f} '
+    return command
+
+def route_cc_cmd(address, dev, algorithm):
+    """use algorithm for the connections with address only(a host route with congctl), passive opens take it too"""
+    return f"ip route replace {address}/32 dev {dev} congctl {algorithm}"
+
+def ecn_marking_cmds(dev, threshold, bw, delay, loss=0, jitter=None, buffer_pkts=1000):
+    """DCTCP style marking on a rate limited link: put a red qdisc between the htb class 5:1 and the netem
+    mininet TCLink created, marking CE on every packet once more than threshold packets are queued.
+    Replacing the netem child of 5:1 deletes it, so netem is added again under red with the link options.
+
+    Args:
+        dev (str): interface, e.g. 's1-eth1'
+        threshold (int): marking threshold K in packets, counts the packets netem holds for the link delay too
+        bw (int): link bandwidth in Mbps
+        delay, loss, jitter: link netem options, refer to netem_change_cmd
+        buffer_pkts (int, optional): netem queue limit. Defaults to 1000, the netem default.
+    Returns:
+        list: tc commands to run in order
+    """
+    qmin = threshold * 1514
+    # probability 1 from min to min + 1 packet is a step, the smallest burst red accepts keeps the average
+    # queue close to the instant queue
+    red = (f'tc qdisc replace dev {dev} parent 5:1 handle 6: red limit {buffer_pkts * 1514} min {qmin} '
+           f'max {qmin + 1514} avpkt 1514 burst {threshold + 1} bandwidth {bw}mbit probability 1 ecn')
+    netem = netem_change_cmd(dev, delay, loss=loss, jitter=jitter, parent="6:").replace('change', 'add', 1)
+    return [red, netem + f'limit {buffer_pkts}']
+
+STACK_SYSCTLS = ['tcp_limit_output_bytes', 'tcp_wmem', 'tcp_rmem']
+STACK_OPTIONS = STACK_SYSCTLS + ['qdisc', 'tso', 'gso']
+
+def sender_stack_cmds(dev, stack):
+    """commands configuring the network stack of one host for the stack options of an experiment
+
+    Args:
+        dev (str): the host interface, e.g. 'hs1-eth0'
+        stack (dict): any of
+            tcp_limit_output_bytes (int): TSQ limit of bytes queued below the socket
+            tcp_wmem, tcp_rmem (str): 'min default max' socket buffer bytes
+            qdisc (str): 'fq', 'fq_codel' or 'pfifo_fast', the host qdisc. Mininet TCLink puts netem(handle 10:)
+                on every host interface for the link delay, the qdisc is added as its child, so packets are
+                paced(fq) after the link delay instead of before, which doesn't change their rate
+            tso, gso (bool): segmentation offload of the interface
+    Returns:
+        list: commands to run on the host in order. The tcp sysctls are per network namespace since linux 4.15,
+            on older kernels they only exist in the root namespace, refer to sysctls_per_namespace
+    """
+    unknown = set(stack) - set(STACK_OPTIONS)
+    if unknown:
+        raise ValueError(f"unknown stack options {sorted(unknown)}, options: {STACK_OPTIONS}")
+    commands = [f'sysctl -w net.ipv4.{name}="{stack[name]}"' for name in STACK_SYSCTLS if name in stack]
+    if stack.get('qdisc'):
+        commands.append(f"tc qdisc add dev {dev} parent 10:1 handle 20: {stack['qdisc']}")
+    offload = " ".join(f"{name} {'on' if stack[name] else 'off'}" for name in ['tso', 'gso'] if name in stack)
+    if offload:
+        commands.append(f"ethtool -K {dev} {offload}")
+    return commands
+
+def sysctls_per_namespace(release=None):
+    """whether the tcp sysctls of STACK_SYSCTLS are per network namespace(linux 4.15 on) on the running kernel,
+    or on release, e.g. '4.14.91'
+    """
+    major, minor = re.match(r'(\d+)\.(\d+)', release or platform.uname().release).groups()
+    return (int(major), int(minor)) >= (4, 15)
+
+def set_global_sysctls(stack):
+    """set the tcp sysctls of stack in the root namespace, for kernels where they are not per namespace
+
+    Returns:
+        dict: the previous values, to put back with set_global_sysctls afterwards
+    """
+    previous = {}
+    for name in STACK_SYSCTLS:
+        if name not in stack:
+            continue
+        path = f"/proc/sys/net/ipv4/{name}"
+        with open(path) as f:
+            previous[name] = " ".join(f.read().split())
+        with open(path, 'w') as f:
+            f.write(str(stack[name]))
+    return previous
+
+def set_cc_module_param(cctype, name, value):
+    """set a module parameter of a kernel cc algorithm, e.g. set_cc_module_param('bbr', 'min_rtt_shift_rounds', 0).
+    Module parameters are global, they apply to all hosts of the network
+
+    Returns:
+        bool: False if the running kernel has no such parameter
+    """
+    path = f"/sys/module/{CC_MODULES.get(cctype, cctype)}/parameters/{name}"
+    if not os.path.exists(path):
+        print_t("warning", f"no module parameter {path}")
+        return False
+    with open(path, 'w') as f:
+        f.write(str(value))
+    return True
+
 def set_kernel_cc_algorithm(host, algorithm):
     """set the cc algorithm on host kernel
 
@@ -94,6 +377,23 @@ def set_kernel_cc_algorithm(host, algorithm):
     
     print("Setting Result: ", result)
 
+def open_log(filename, binary=False):
+    """open a log file for reading, .gz files written by log_offload are decompressed, either named directly
+    (e.g. from os.listdir) or by their uncompressed name
+    """
+    if not filename.endswith('.gz') and not os.path.exists(filename) and os.path.exists(filename + '.gz'):
+        filename += '.gz'
+    if filename.endswith('.gz'):
+        return gzip.open(filename, 'rb' if binary else 'rt')
+    return open(filename, 'rb' if binary else 'r')
+
+def log_exists(filename):
+    return os.path.exists(filename) or os.path.exists(filename + '.gz')
+
+def log_name(filename):
+    """strip the .gz suffix added by log_offload, so host names stay the same"""
+    return filename[:-3] if filename.endswith('.gz') else filename
+
 def print_t(t="info", message=""):
     if t == "info":
         m = f"\033[0;30m{message}\033[0m"